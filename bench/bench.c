@@ -0,0 +1,347 @@
+#define _USE_MATH_DEFINES
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "../diffevo/diffevo.h"
+
+//
+// Benchmark of DiffEvoCL on standard test functions. Every function is solved for a range of
+// dimensions and population sizes with fixed seeds, once for a fixed number of generations to
+// measure the throughput and the final error, and once until the error drops below TARGET_ERROR
+// to measure the time to target. The results are written as JSON, so that different versions of
+// the library can be compared. Before that, the Philox known answers are checked on the host and
+// the device, see diffevo_self_check().
+//
+// usage: bench [-gpu] [-float] [-soa] [-fused] [-persistent N] [-native] [-k kernel_dir]
+//              [-o results.json]
+//
+// -soa, -fused and -persistent select the population layout and the kernels (persistent implies
+// fused), -native runs on the host with the C versions of the functions below instead. With the
+// same seeds, runs differing only in these switches compute the same generations, so their
+// results can be compared directly. The JSON header records the configuration.
+//
+
+// Number of generations of the throughput runs, and upper bound for the time to target runs.
+#define NUM_ITER 1000
+
+// Every configuration is run once per seed 1, ..., NUM_SEEDS.
+#define NUM_SEEDS 3
+
+// The time to target runs stop once the best cost is within this distance of the optimum.
+#define TARGET_ERROR 1e-6
+
+// Generations between two checks of the target cost.
+#define CHECK_INTERVAL 10
+
+typedef struct {
+    const char *name;
+
+    // File of the eval() kernel (and cost() for fused mode) in the kernel directory.
+    const char *file;
+
+    // The same function for the native backend.
+    diffevo_cost_fn cost_fn;
+
+    // Cost of the global minimum.
+    double optimum;
+
+    // Initial distribution.
+    double mu, sigma;
+
+    // Number of attributes the function is defined for, 0 if any.
+    unsigned num_attr;
+} function_t;
+
+//
+// Host versions of the eval_*.cl kernels, see there.
+//
+
+double sphere(const double *x, unsigned num_attr, const void *eval_data) {
+    double sum = 0.0;
+    for (unsigned a = 0; a < num_attr; a++) {
+        sum += x[a] * x[a];
+    }
+    return sum;
+}
+
+double rastrigin(const double *x, unsigned num_attr, const void *eval_data) {
+    double sum = 10.0 * num_attr;
+    for (unsigned a = 0; a < num_attr; a++) {
+        sum += x[a] * x[a] - 10.0 * cos(2.0 * M_PI * x[a]);
+    }
+    return sum;
+}
+
+double rosenbrock(const double *x, unsigned num_attr, const void *eval_data) {
+    double sum = 0.0;
+    for (unsigned a = 1; a < num_attr; a++) {
+        const double d = x[a] - x[a - 1] * x[a - 1];
+        sum += 100.0 * d * d + (1.0 - x[a - 1]) * (1.0 - x[a - 1]);
+    }
+    return sum;
+}
+
+double ackley(const double *x, unsigned num_attr, const void *eval_data) {
+    double sq = 0.0, cs = 0.0;
+    for (unsigned a = 0; a < num_attr; a++) {
+        sq += x[a] * x[a];
+        cs += cos(2.0 * M_PI * x[a]);
+    }
+    return -20.0 * exp(-0.2 * sqrt(sq / num_attr)) - exp(cs / num_attr) + 20.0 + M_E;
+}
+
+double schaffer4(const double *x, unsigned num_attr, const void *eval_data) {
+    const double c = cos(sin(fabs(x[0] * x[0] - x[1] * x[1])));
+    const double d = 1.0 + 0.001 * (x[0] * x[0] + x[1] * x[1]);
+    return 0.5 + (c * c - 0.5) / (d * d);
+}
+
+double griewank(const double *x, unsigned num_attr, const void *eval_data) {
+    double sum = 0.0, prod = 1.0;
+    for (unsigned a = 0; a < num_attr; a++) {
+        sum += x[a] * x[a];
+        prod *= cos(x[a] / sqrt(a + 1.0));
+    }
+    return 1.0 + sum / 4000.0 - prod;
+}
+
+const function_t functions[] = {
+    { "sphere", "eval_sphere.cl", sphere, 0.0, 0.0, 5.0, 0 },
+    { "rastrigin", "eval_rastrigin.cl", rastrigin, 0.0, 0.0, 3.0, 0 },
+    { "rosenbrock", "eval_rosenbrock.cl", rosenbrock, 0.0, 0.0, 2.0, 0 },
+    { "ackley", "eval_ackley.cl", ackley, 0.0, 0.0, 15.0, 0 },
+    { "schaffer4", "eval_schaffer.cl", schaffer4, 0.29257863203598033, 0.0, 50.0, 2 },
+    { "griewank", "eval_griewank.cl", griewank, 0.0, 0.0, 300.0, 0 },
+};
+
+const unsigned dims[] = { 2, 10, 30 };
+const unsigned pops[] = { 32, 128 };
+
+#define COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+double now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Solves a single problem with the given seed, returns the wall-clock time of the run or a
+// negative value on error.
+double run(diffevo_t *de, const diffevo_params_t *params, const function_t *f, unsigned seed,
+    double *best, double *cost, diffevo_stats_t *stats) {
+    diffevo_problem_t problem = { 0 };
+    problem.mu = f->mu;
+    problem.sigma = f->sigma;
+    problem.seed = seed;
+
+    const double start = now();
+
+    if (0 != diffevo_run_batch(de, params, &problem, 1, best, cost)) {
+        return -1.0;
+    }
+
+    const double elapsed = now() - start;
+
+    if (0 != diffevo_stats(de, stats)) {
+        return -1.0;
+    }
+
+    return elapsed;
+}
+
+// Runs all seeds of one configuration and writes its JSON object. Returns 0 on success.
+int bench(diffevo_t *de, diffevo_params_t params, const function_t *f, FILE *out, int first) {
+    double *best = malloc(params.num_attr * sizeof(double));
+    if (NULL == best) {
+        return -1;
+    }
+
+    double time = 0.0;
+    double error = 0.0;
+    double time_to_target = 0.0;
+    unsigned long long num_gen = 0;
+    unsigned long long num_evals = 0;
+    unsigned num_reached = 0;
+
+    for (unsigned seed = 1; seed <= NUM_SEEDS; seed++) {
+        double cost;
+        diffevo_stats_t stats;
+
+        // Throughput and final error after exactly NUM_ITER generations.
+        params.stop_params.criteria = 0;
+
+        const double t = run(de, &params, f, seed, best, &cost, &stats);
+        if (t < 0.0) {
+            free(best);
+            return -1;
+        }
+
+        time += t;
+        error += cost - f->optimum;
+        num_gen += stats.num_gen;
+        num_evals += stats.num_evals;
+
+        // Time until the optimum is reached (if at all).
+        params.stop_params.criteria = DIFFEVO_STOP_COST;
+        params.stop_params.check_interval = CHECK_INTERVAL;
+        params.stop_params.cost_target = f->optimum + TARGET_ERROR;
+
+        const double t_target = run(de, &params, f, seed, best, &cost, &stats);
+        if (t_target < 0.0) {
+            free(best);
+            return -1;
+        }
+
+        if (DIFFEVO_STOP_COST == stats.stop_reason) {
+            time_to_target += t_target;
+            num_reached++;
+        }
+    }
+
+    free(best);
+
+    fprintf(out, "%s    {\"function\": \"%s\", \"num_attr\": %u, \"num_pop\": %u, "
+        "\"gens_per_sec\": %.6g, \"evals_per_sec\": %.6g, \"final_error\": %.6g, "
+        "\"reached_target\": %u, ", first ? "" : ",\n", f->name, params.num_attr,
+        params.num_pop, num_gen / time, num_evals / time, error / NUM_SEEDS, num_reached);
+
+    // Mean over the seeds that reached the target.
+    if (0 != num_reached) {
+        fprintf(out, "\"time_to_target\": %.6g}", time_to_target / num_reached);
+    } else {
+        fprintf(out, "\"time_to_target\": null}");
+    }
+
+    fflush(out);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *kernel_dir = ".";
+    const char *out_path = NULL;
+    unsigned device_type = DIFFEVO_DEVICE_CPU;
+    unsigned precision = DIFFEVO_PRECISION_DOUBLE;
+    unsigned layout = DIFFEVO_LAYOUT_AOS;
+    unsigned fused = 0;
+    unsigned persistent = 0;
+    unsigned backend = DIFFEVO_BACKEND_OPENCL;
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "-gpu")) {
+            device_type = DIFFEVO_DEVICE_GPU;
+        } else if (0 == strcmp(argv[i], "-float")) {
+            precision = DIFFEVO_PRECISION_FLOAT;
+        } else if (0 == strcmp(argv[i], "-soa")) {
+            layout = DIFFEVO_LAYOUT_SOA;
+        } else if (0 == strcmp(argv[i], "-fused")) {
+            fused = 1;
+        } else if (0 == strcmp(argv[i], "-persistent") && i + 1 < argc) {
+            persistent = (unsigned) strtoul(argv[++i], NULL, 10);
+            fused = 1;
+        } else if (0 == strcmp(argv[i], "-native")) {
+            backend = DIFFEVO_BACKEND_NATIVE;
+        } else if (0 == strcmp(argv[i], "-k") && i + 1 < argc) {
+            kernel_dir = argv[++i];
+        } else if (0 == strcmp(argv[i], "-o") && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [-gpu] [-float] [-soa] [-fused] [-persistent N] [-native] "
+                "[-k kernel_dir] [-o results.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    FILE *out = NULL != out_path ? fopen(out_path, "w") : stdout;
+    if (NULL == out) {
+        fprintf(stderr, "Could not open %s\n", out_path);
+        return 1;
+    }
+
+    // The native backend ignores the device, precision, layout and kernels.
+    const int native = DIFFEVO_BACKEND_NATIVE == backend;
+
+    fprintf(out, "{\n  \"backend\": \"%s\",\n  \"device\": \"%s\",\n  \"precision\": \"%s\",\n"
+        "  \"layout\": \"%s\",\n  \"mode\": \"%s\",\n  \"persistent\": %u,\n"
+        "  \"rng\": \"philox\",\n  \"num_iter\": %u,\n  \"num_seeds\": %u,\n"
+        "  \"target_error\": %g,\n  \"results\": [\n",
+        native ? "native" : "opencl",
+        native ? "host" : DIFFEVO_DEVICE_GPU == device_type ? "gpu" : "cpu",
+        native || DIFFEVO_PRECISION_FLOAT != precision ? "double" : "float",
+        native || DIFFEVO_LAYOUT_SOA != layout ? "aos" : "soa",
+        native ? "native" : 0 != persistent ? "persistent" : fused ? "fused" : "kernels",
+        native ? 0 : persistent, NUM_ITER, NUM_SEEDS, TARGET_ERROR);
+
+    int err = 0;
+    int first = 1;
+
+    for (unsigned i = 0; i < COUNT(functions) && 0 == err; i++) {
+        const function_t *f = &functions[i];
+
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", kernel_dir, f->file);
+
+        diffevo_params_t params = { 0 };
+        params.num_iter = NUM_ITER;
+        params.shrink = 0.6;
+        params.crossover = 0.5;
+        params.device_type = device_type;
+        params.precision = precision;
+        params.layout = layout;
+        params.fused = fused;
+        params.persistent = persistent;
+        params.backend = backend;
+        params.cost_fn = native ? f->cost_fn : NULL;
+
+        // Philox makes the seeded runs identical across kernel variants and backends.
+        params.rng = DIFFEVO_RNG_PHILOX;
+
+        // Sized for the largest configuration, so that the runs never reallocate.
+        params.num_pop = pops[COUNT(pops) - 1];
+        params.num_attr = 0 != f->num_attr ? f->num_attr : dims[COUNT(dims) - 1];
+
+        diffevo_t *de;
+        if (0 != diffevo_create(native ? NULL : path, &params, &de)) {
+            err = -1;
+            break;
+        }
+
+        // The seeded results are only comparable if Philox gives the reference random numbers.
+        if (0 == i && 0 != diffevo_self_check(de)) {
+            fprintf(stderr, "Self-check failed\n");
+            diffevo_release(de);
+            err = -1;
+            break;
+        }
+
+        for (unsigned d = 0; d < COUNT(dims) && 0 == err; d++) {
+            if (0 != f->num_attr && dims[d] != f->num_attr) {
+                continue;
+            }
+
+            for (unsigned p = 0; p < COUNT(pops) && 0 == err; p++) {
+                params.num_attr = dims[d];
+                params.num_pop = pops[p];
+
+                err = bench(de, params, f, out, first);
+                first = 0;
+
+                fprintf(stderr, "%s: %u attributes, %u members%s\n", f->name, dims[d], pops[p],
+                    0 != err ? " failed" : "");
+            }
+        }
+
+        diffevo_release(de);
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+
+    if (stdout != out) {
+        fclose(out);
+    }
+
+    return 0 != err ? 1 : 0;
+}
@@ -0,0 +1,33 @@
+// Ackley function: -20 exp(-0.2 sqrt(mean of x_i^2)) - exp(mean of cos(2 pi x_i)) + 20 + e.
+// Nearly flat outer region with many local minima, minimum 0 at x = 0.
+__kernel void eval(
+    DIFFEVO_CONST real_t *restrict pop,
+    __global real_t *restrict costs,
+    unsigned num_pop,
+    unsigned num_attr,
+    DIFFEVO_CONST real_t *restrict eval_data,
+    __local real_t *restrict local_data
+) {
+    const unsigned id = get_global_id(0);
+
+    real_t sq = 0.0;
+    real_t cs = 0.0;
+    for (unsigned a = 0; a < num_attr; a++) {
+        const real_t x = DIFFEVO_POP(pop, id, a);
+        sq += x * x;
+        cs += cospi(2.0 * x);
+    }
+
+    costs[id] = -20.0 * exp(-0.2 * sqrt(sq / num_attr)) - exp(cs / num_attr) + 20.0 + M_E;
+}
+
+// The same function for fused mode.
+real_t cost(const real_t *x, unsigned num_attr, DIFFEVO_CONST void *eval_data) {
+    real_t sq = 0.0;
+    real_t cs = 0.0;
+    for (unsigned a = 0; a < num_attr; a++) {
+        sq += x[a] * x[a];
+        cs += cospi(2.0 * x[a]);
+    }
+    return -20.0 * exp(-0.2 * sqrt(sq / num_attr)) - exp(cs / num_attr) + 20.0 + M_E;
+}
@@ -0,0 +1,33 @@
+// Griewank function: 1 + sum of x_i^2 / 4000 - product of cos(x_i / sqrt(i + 1)). Minimum 0 at
+// x = 0.
+__kernel void eval(
+    DIFFEVO_CONST real_t *restrict pop,
+    __global real_t *restrict costs,
+    unsigned num_pop,
+    unsigned num_attr,
+    DIFFEVO_CONST real_t *restrict eval_data,
+    __local real_t *restrict local_data
+) {
+    const unsigned id = get_global_id(0);
+
+    real_t sum = 0.0;
+    real_t prod = 1.0;
+    for (unsigned a = 0; a < num_attr; a++) {
+        const real_t x = DIFFEVO_POP(pop, id, a);
+        sum += x * x;
+        prod *= cos(x * rsqrt(a + 1.0));
+    }
+
+    costs[id] = 1.0 + sum / 4000.0 - prod;
+}
+
+// The same function for fused mode.
+real_t cost(const real_t *x, unsigned num_attr, DIFFEVO_CONST void *eval_data) {
+    real_t sum = 0.0;
+    real_t prod = 1.0;
+    for (unsigned a = 0; a < num_attr; a++) {
+        sum += x[a] * x[a];
+        prod *= cos(x[a] * rsqrt(a + 1.0));
+    }
+    return 1.0 + sum / 4000.0 - prod;
+}
@@ -0,0 +1,32 @@
+// Rosenbrock function: sum of 100 (x_i+1 - x_i^2)^2 + (1 - x_i)^2. Narrow curved valley, minimum 0
+// at x = 1.
+__kernel void eval(
+    DIFFEVO_CONST real_t *restrict pop,
+    __global real_t *restrict costs,
+    unsigned num_pop,
+    unsigned num_attr,
+    DIFFEVO_CONST real_t *restrict eval_data,
+    __local real_t *restrict local_data
+) {
+    const unsigned id = get_global_id(0);
+
+    real_t sum = 0.0;
+    real_t x = DIFFEVO_POP(pop, id, 0);
+    for (unsigned a = 1; a < num_attr; a++) {
+        const real_t y = DIFFEVO_POP(pop, id, a);
+        sum += 100.0 * (y - x * x) * (y - x * x) + (1.0 - x) * (1.0 - x);
+        x = y;
+    }
+
+    costs[id] = sum;
+}
+
+// The same function for fused mode.
+real_t cost(const real_t *x, unsigned num_attr, DIFFEVO_CONST void *eval_data) {
+    real_t sum = 0.0;
+    for (unsigned a = 1; a < num_attr; a++) {
+        sum += 100.0 * (x[a] - x[a - 1] * x[a - 1]) * (x[a] - x[a - 1] * x[a - 1])
+            + (1.0 - x[a - 1]) * (1.0 - x[a - 1]);
+    }
+    return sum;
+}
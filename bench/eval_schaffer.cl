@@ -0,0 +1,27 @@
+// Schaffer function N. 4 (two attributes only): 0.5 + (cos^2(sin(|x^2 - y^2|)) - 0.5) /
+// (1 + 0.001 (x^2 + y^2))^2. Minimum 0.292579 at (0, +-1.25313) and (+-1.25313, 0).
+__kernel void eval(
+    DIFFEVO_CONST real_t *restrict pop,
+    __global real_t *restrict costs,
+    unsigned num_pop,
+    unsigned num_attr,
+    DIFFEVO_CONST real_t *restrict eval_data,
+    __local real_t *restrict local_data
+) {
+    const unsigned id = get_global_id(0);
+
+    const real_t x = DIFFEVO_POP(pop, id, 0);
+    const real_t y = DIFFEVO_POP(pop, id, 1);
+
+    const real_t c = cos(sin(fabs(x * x - y * y)));
+    const real_t d = 1.0 + 0.001 * (x * x + y * y);
+
+    costs[id] = 0.5 + (c * c - 0.5) / (d * d);
+}
+
+// The same function for fused mode.
+real_t cost(const real_t *x, unsigned num_attr, DIFFEVO_CONST void *eval_data) {
+    const real_t c = cos(sin(fabs(x[0] * x[0] - x[1] * x[1])));
+    const real_t d = 1.0 + 0.001 * (x[0] * x[0] + x[1] * x[1]);
+    return 0.5 + (c * c - 0.5) / (d * d);
+}
@@ -0,0 +1,28 @@
+// Sphere function: sum of x_i^2. Minimum 0 at x = 0.
+__kernel void eval(
+    DIFFEVO_CONST real_t *restrict pop,
+    __global real_t *restrict costs,
+    unsigned num_pop,
+    unsigned num_attr,
+    DIFFEVO_CONST real_t *restrict eval_data,
+    __local real_t *restrict local_data
+) {
+    const unsigned id = get_global_id(0);
+
+    real_t sum = 0.0;
+    for (unsigned a = 0; a < num_attr; a++) {
+        const real_t x = DIFFEVO_POP(pop, id, a);
+        sum += x * x;
+    }
+
+    costs[id] = sum;
+}
+
+// The same function for fused mode.
+real_t cost(const real_t *x, unsigned num_attr, DIFFEVO_CONST void *eval_data) {
+    real_t sum = 0.0;
+    for (unsigned a = 0; a < num_attr; a++) {
+        sum += x[a] * x[a];
+    }
+    return sum;
+}
@@ -6,12 +6,20 @@
 #include <limits.h>
 #include <direct.h>
 #include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <process.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
 
 #define _diffevo_export
 
-#include "diffevo.h"
+#include "diffevo_internal.h"
 
-int last_error;
+// Result of the current public call, per thread, so that concurrent runs on different handles do
+// not see each other's errors.
+__declspec(thread) int last_error;
 
 void report_error(char *msg) {
     last_error = -1;
@@ -27,28 +35,366 @@ void report_error_code(char *msg, int code) {
 const char *algo_src =
 #include "diffevo.cl"
 ;
+const char *fused_src =
+#include "diffevo_fused.cl"
+;
+const char *feasible_src =
+#include "diffevo_feasible.cl"
+;
+
+// Definitions preceding both the eval() and the algorithm source. They cannot be part of
+// diffevo.cl, because the stringification trick above does not preserve preprocessor directives.
+// Every parameter that may be specialized at compile time (see build_options()) falls back to
+// the kernel argument of the same name.
+const char *algo_defs =
+    "#ifdef DIFFEVO_NUM_POP\n"
+    "#define _num_pop DIFFEVO_NUM_POP\n"
+    "#else\n"
+    "#define _num_pop num_pop\n"
+    "#endif\n"
+    "#ifdef DIFFEVO_NUM_ATTR\n"
+    "#define _num_attr DIFFEVO_NUM_ATTR\n"
+    "#else\n"
+    "#define _num_attr num_attr\n"
+    "#endif\n"
+    "#ifdef DIFFEVO_SHRINK\n"
+    "#define _shrink DIFFEVO_SHRINK\n"
+    "#else\n"
+    "#define _shrink shrink\n"
+    "#endif\n"
+    "#ifdef DIFFEVO_CROSSOVER\n"
+    "#define _crossover DIFFEVO_CROSSOVER\n"
+    "#else\n"
+    "#define _crossover crossover\n"
+    "#endif\n"
+    // Accessor for attribute a of member n, hiding the population layout. In the structure of
+    // arrays layout (DIFFEVO_SOA set to the vector width) attribute-wise rows are padded to a
+    // multiple of the vector width.
+    "#ifdef DIFFEVO_SOA\n"
+    "#define _pop_stride ((_num_pop + DIFFEVO_SOA - 1) / DIFFEVO_SOA * DIFFEVO_SOA)\n"
+    "#define DIFFEVO_POP(p, n, a) (p)[(a) * _pop_stride + (n)]\n"
+    "#else\n"
+    "#define DIFFEVO_POP(p, n, a) (p)[(n) * _num_attr + (a)]\n"
+    "#endif\n"
+    // Address space of read-only kernel arguments. The constant address space is preferred, but
+    // limited in size (usually 64 KB), see build_options().
+    "#ifdef DIFFEVO_GLOBAL_CONST\n"
+    "#define DIFFEVO_CONST __global const\n"
+    "#else\n"
+    "#define DIFFEVO_CONST __constant\n"
+    "#endif\n"
+    // Problem member n belongs to and its slice of the eval data. Only a batch of more than one
+    // problem has more than one slice (DIFFEVO_DATA_STRIDE bytes apart).
+    "#define DIFFEVO_PROBLEM(n) ((n) / _num_pop)\n"
+    "#ifdef DIFFEVO_DATA_STRIDE\n"
+    "#define DIFFEVO_PROBLEM_DATA(d, n) ((DIFFEVO_CONST void *) "
+        "((DIFFEVO_CONST char *) (d) + DIFFEVO_PROBLEM(n) * DIFFEVO_DATA_STRIDE))\n"
+    "#else\n"
+    "#define DIFFEVO_PROBLEM_DATA(d, n) ((DIFFEVO_CONST void *) (d))\n"
+    "#endif\n"
+    // Random number generator of the kernels, see diffevo.cl. With Philox, the rng kernel argument
+    // is the buffer of the seeds, which is only read.
+    "#ifdef DIFFEVO_PHILOX\n"
+    "#define DIFFEVO_RNG_STATE DIFFEVO_CONST unsigned\n"
+    "#define rng_t philox_t\n"
+    "#define rng_init(r, seed) philox_load(r, seed, 0)\n"
+    "#define rng_load(r, s, id, gen) philox_load(r, (s)[id], gen)\n"
+    "#define rng_store(s, id, r)\n"
+    "#define rng_next_gen(r, gen) philox_load(r, (r)->key, gen)\n"
+    "#define rng_unsigned philox_unsigned\n"
+    "#define rng_real philox_real\n"
+    "#define rng_crossover(s, id, gen, salt, a) philox_real_at((s)[id], gen, 3 + (a))\n"
+    "#define rng_resample(r, a) philox_real_at((r)->key, (r)->gen, 3 + _num_attr + (a))\n"
+    "#define rng_resample_at(s, id, gen, salt, a) "
+        "philox_real_at((s)[id], gen, 3 + _num_attr + (a))\n"
+    "#define rng_extra(r, i) philox_unsigned_at((r)->key, (r)->gen, 3 + 2 * _num_attr + (i))\n"
+    "#else\n"
+    "#define DIFFEVO_RNG_STATE __global mt32_t\n"
+    "#define rng_t mt32_t\n"
+    "#define rng_init mt32_init\n"
+    "#define rng_load(r, s, id, gen) (*(r) = (s)[id])\n"
+    "#define rng_store(s, id, r) ((s)[id] = *(r))\n"
+    "#define rng_next_gen(r, gen)\n"
+    "#define rng_unsigned mt32_unsigned\n"
+    "#define rng_real mt32_real\n"
+    "#define rng_crossover(s, id, gen, salt, a) hash32_real(salt, a)\n"
+    "#define rng_resample(r, a) hash32_real(~(r)->st[0], a)\n"
+    "#define rng_resample_at(s, id, gen, salt, a) hash32_real(~(salt), a)\n"
+    "#define rng_extra(r, i) rng_unsigned(r)\n"
+    "#endif\n"
+    "#define rng_forced(r) rng_extra(r, 0)\n"
+    // Floating point type of the populations and costs, see DIFFEVO_PRECISION_FLOAT. In single
+    // precision, random numbers keep the 24 bits a float can hold, so that they stay below 1.
+    "#ifdef DIFFEVO_FLOAT\n"
+    "typedef float real_t;\n"
+    "#define _pi M_PI_F\n"
+    "#define DIFFEVO_TO_REAL(u) ((float) ((u) >> 8) * 0x1p-24f)\n"
+    "#else\n"
+    "typedef double real_t;\n"
+    "#define _pi M_PI\n"
+    "#define DIFFEVO_TO_REAL(u) ((u) * (1.0 / 4294967296.0))\n"
+    "#endif\n"
+    // Bounds of the attributes (DIFFEVO_BOUNDS set to the repair strategy), see diffevo.cl. Only
+    // draws the re-sampling value u if x actually left its bounds.
+    "#ifdef DIFFEVO_BOUNDS\n"
+    "#define _repair_mode DIFFEVO_BOUNDS\n"
+    "#define _repair(x, b, a, u) ((x) < (b)[a] || (x) > (b)[_num_attr + (a)] "
+        "? repair(x, (b)[a], (b)[_num_attr + (a)], u) : (x))\n"
+    "#define _init_attr(z, b, a, u) ((b)[a] + (u) * ((b)[_num_attr + (a)] - (b)[a]))\n"
+    "#else\n"
+    "#define _repair_mode 0\n"
+    "#define _repair(x, b, a, u) (x)\n"
+    "#define _init_attr(z, b, a, u) (z)\n"
+    "#endif\n"
+    // User feasible() function (DIFFEVO_FEASIBLE), d is the eval data of the problem.
+    "#ifdef DIFFEVO_FEASIBLE\n"
+    "#define _feasible(x, d) feasible(x, _num_attr, d)\n"
+    "#else\n"
+    "#define _feasible(x, d) true\n"
+    "#endif\n"
+    // Attribute that is always taken from the mutant (DIFFEVO_FORCE_MUTANT), d is a random number.
+    // Without it, no attribute is, and the draw is not even made.
+    "#ifdef DIFFEVO_FORCE_MUTANT\n"
+    "#define _mutant_index(d) ((d) % _num_attr)\n"
+    "#else\n"
+    "#define _mutant_index(d) UINT_MAX\n"
+    "#endif\n"
+    // Mutant attribute of the mutation strategy (DIFFEVO_STRATEGY, see strategy) from the attribute
+    // of the member p, of the best member b and of the donors u, v, w, v2 and w2, f is the shrink
+    // factor. Only the attributes a strategy uses are read.
+    "#ifndef DIFFEVO_STRATEGY\n"
+    "#define DIFFEVO_STRATEGY 0\n"
+    "#endif\n"
+    "#if DIFFEVO_STRATEGY == 1\n"
+    "#define _mutant(p, b, u, v, w, v2, w2, f) ((b) + (f) * ((u) - (v)))\n"
+    "#elif DIFFEVO_STRATEGY == 2\n"
+    "#define _mutant(p, b, u, v, w, v2, w2, f) ((p) + (f) * ((b) - (p)) + (f) * ((u) - (v)))\n"
+    "#elif DIFFEVO_STRATEGY == 3\n"
+    "#define _mutant(p, b, u, v, w, v2, w2, f) ((u) + (f) * ((v) - (w)) + (f) * ((v2) - (w2)))\n"
+    "#else\n"
+    "#define _mutant(p, b, u, v, w, v2, w2, f) ((u) + (f) * ((v) - (w)))\n"
+    "#endif\n"
+    "#define _uses_best (DIFFEVO_STRATEGY == 1 || DIFFEVO_STRATEGY == 2)\n"
+    "#define _num_donors (DIFFEVO_STRATEGY == 3 ? 5 : 3)\n"
+    // Attribute a of the best member of the problem of member n in the status, see reduce().
+    "#define _best(s, n, a) (s)[DIFFEVO_PROBLEM(n) * (3 + _num_attr) + 3 + (a)]\n"
+    // Adaptation of the control parameters (DIFFEVO_ADAPT set to the mode, DIFFEVO_MEMORY to the
+    // size of the SHADE memory), see adapt_ctrl().
+    "#ifdef DIFFEVO_ADAPT\n"
+    "#define _adapt_mode DIFFEVO_ADAPT\n"
+    "#define _memory_size DIFFEVO_MEMORY\n"
+    "#else\n"
+    "#define _adapt_mode 0\n"
+    "#define _memory_size 1\n"
+    "#endif\n";
+
+// Upper bound for the length of the generated build options.
+#define MAX_OPTIONS_LEN 512
+
+// Upper bound for the number of sources a program is built from.
+#define MAX_SOURCES 8
+
+// Population buffers are allocated for a multiple of this many members, so that the padded rows
+// of the structure of arrays layout always fit (vector widths are powers of two up to 16).
+#define POP_ALIGN 16
+
+// The eval data slices of a batch start at a multiple of this many bytes.
+#define DATA_ALIGN 16
+
+// Command whose device times are collected once the run has finished, see collect_profile().
+typedef struct {
+    cl_event evt;
+    unsigned type;
+
+    // Host time the command was enqueued at, which places it on the host timeline of the trace.
+    double enqueued;
+} profile_record_t;
+
+// Span of the trace, on the host (tid 0) or device (tid 1) timeline.
+typedef struct {
+    const char *name;
+    unsigned tid;
+    double start, end;
+} trace_span_t;
+
+const char *kernel_names[DIFFEVO_NUM_KERNELS] = {
+    "init", "eval", "mutate", "select", "reduce", "fused", "persistent", "transfer"
+};
+
+const char *phase_names[DIFFEVO_NUM_PHASES] = {
+    "context", "build", "setup", "readback", "host_eval"
+};
+
+// Known answers of Philox4x32-10, see diffevo_self_check(). The first PHILOX_KAT_FULL vectors are
+// the reference vectors of Random123 (counter and key), the others are draws of philox_block()
+// (key, generation and block), each followed by the four expected outputs.
+#define PHILOX_KAT_FULL 3
+#define PHILOX_KAT_COUNT 5
+
+const unsigned philox_kat[PHILOX_KAT_COUNT][10] = {
+    { 0, 0, 0, 0, 0, 0, 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 },
+    { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+        0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd },
+    { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344, 0xa4093822, 0x299f31d0,
+        0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 },
+    { 42, 1, 0, 0, 0, 0, 0xab934b86, 0x711b86c0, 0x99a0269b, 0x33b0f69c },
+    { 0x9e3779b9, 1000, 7, 0, 0, 0, 0xeda26ca6, 0x16fb23f3, 0xcab77ccf, 0x56108527 },
+};
+
+struct diffevo {
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+    cl_program program;
+
+    struct {
+        cl_mem rng, seeds, dist, pop[3], costs[3];
+
+        // Given initial members (allocated on first use, like the population buffers) and their
+        // number per problem, see init_params.
+        cl_mem warm, num_warm;
+        cl_mem eval_data;
+        cl_mem status;
+
+        // Bounds of the attributes (lower ones, then upper ones), and whether the trials have to
+        // be evaluated, i.e. differ from their parent (and are feasible, see constraint_params).
+        cl_mem bounds, flags;
+
+        // Number of trials the fused kernels did not evaluate, see num_evals_saved.
+        cl_mem saved;
+
+        // Control parameters (shrink, crossover) of every member or the SHADE memory of every
+        // problem, and the ones of every trial with its gain, see adapt_params.
+        cl_mem ctrl, trial;
+
+        // Pinned staging buffers through which the host evaluates the trial population.
+        cl_mem host_pop, host_costs;
+    } buffers;
+
+    struct {
+        cl_kernel init, eval, mutate, select, reduce;
+        cl_kernel mutate_2d, select_2d;
+        cl_kernel fused_eval, generation, generations;
+        cl_kernel check_feasible;
+        cl_kernel adapt;
+    } kernels;
+
+    // Capacity the population buffers are currently allocated for (members of all problems). They
+    // are only reallocated once a run needs more problems, members or attributes than this.
+    unsigned cap_problems, cap_members, cap_attr;
+
+    // Size of the reals the population buffers are allocated for, see real_size().
+    size_t cap_real;
+
+    // Capacity of the eval data buffer in bytes.
+    unsigned cap_eval_data;
+
+    // Application memory the eval data buffer uses in zero-copy mode, NULL otherwise.
+    const void *eval_data_host;
+
+    // User eval() source, kept around in case the program has to be rebuilt.
+    char *eval_src;
+    size_t eval_src_len;
+
+    // Directory of the program binary cache, NULL if disabled.
+    char *cache_dir;
+
+    // Build options the current program was compiled with.
+    char options[MAX_OPTIONS_LEN];
 
-cl_device_id device;
-cl_context context;
-cl_command_queue queue;
-cl_program program;
+    // Whether the current program was built in fused mode (cost() instead of eval()).
+    unsigned fused;
 
-struct {
-    cl_mem rng, seeds, pop[3], costs[3];
-    cl_mem eval_data;
-} buffers;
+    // Whether the current program was built with the Philox RNG, see rng_buffer().
+    unsigned philox;
 
-struct {
-    cl_kernel init, eval, mutate, select;
-} kernels;
+    // Whether the current program was built with a feasible() function (mutate_feasible() and
+    // select_feasible() instead of mutate() and select()).
+    unsigned feasible;
+
+    // Whether the current program was built to have the costs evaluated by the host (cost_fn
+    // instead of eval()).
+    unsigned host_eval;
+
+    // Number of problems of the current run, 1 unless diffevo_run_batch() is used.
+    unsigned num_problems;
+    const diffevo_problem_t *problems;
+
+    // Backend the handle was created for, see DIFFEVO_BACKEND_*. A native handle has no OpenCL
+    // state at all.
+    unsigned backend;
+    native_t *native;
+
+    // Handles of the islands, one per device, if the handle was created with num_islands > 1.
+    // The handle itself has no OpenCL state then.
+    diffevo_t **islands;
+    unsigned num_islands;
+
+    // Type of the device to select, see DIFFEVO_DEVICE_*.
+    unsigned device_type;
+
+    // Whether the queue was created with profiling enabled, and whether a trace is recorded.
+    unsigned profiling, tracing;
+
+    // Profile since the end of the previous run.
+    diffevo_profile_t profile;
+
+    // Whether a run is in progress on the handle (1), and whether it was asked to stop early, see
+    // diffevo_cancel().
+    volatile LONG busy, cancel;
+
+    // Whether the current run was started by diffevo_run_async(), see run_batch().
+    unsigned async;
+
+    // Commands of the current run and spans of the trace since the end of the previous run.
+    profile_record_t *records;
+    unsigned num_records, cap_records;
+    trace_span_t *spans;
+    unsigned num_spans, cap_spans;
+
+    // Statistics of the most recent run.
+    diffevo_stats_t stats;
+};
 
 #define _if_err_ret(msg) if (CL_SUCCESS != err) { report_error_code(msg, err); return -1; }
+#define _if_err_die(msg) if(CL_SUCCESS != err) { report_error_code(msg, err); goto __CleanUp; }
+
+int create_queue(diffevo_t *de) {
+    cl_int err;
+
+    de->context = clCreateContext(NULL, 1, &de->device, NULL, NULL, &err);
+    _if_err_ret("clCreateContext() failed");
+    // Profiling is opt-in, as timestamping every command may slow down the queue.
+    const cl_queue_properties props[] = { CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0 };
 
-int init_cl(void) {
+    de->queue = clCreateCommandQueueWithProperties(de->context, de->device,
+        de->profiling ? props : NULL, &err);
+    _if_err_ret("clCreateCommandQueueWithProperties() failed");
+
+    return 0;
+}
+
+// Creates the context and queue on the given device, NULL for the default device.
+int init_cl(diffevo_t *de, cl_device_id device) {
     cl_int err;
 
-    // TODO: This code just picks the first device it can find. Maybe we want to check for
-    // a suitable GPU/CPU first? Especially check that CL version >= 2.0...
+    if (NULL != device) {
+        // Sub-devices are reference counted, the handle keeps its own reference.
+        err = clRetainDevice(device);
+        _if_err_ret("clRetainDevice() failed");
+        de->device = device;
+
+        return create_queue(de);
+    }
+
+    // TODO: Check that CL version >= 2.0...
+
+    cl_device_type type = CL_DEVICE_TYPE_ALL;
+    if (DIFFEVO_DEVICE_CPU == de->device_type) {
+        type = CL_DEVICE_TYPE_CPU;
+    } else if (DIFFEVO_DEVICE_GPU == de->device_type) {
+        type = CL_DEVICE_TYPE_GPU;
+    }
 
     cl_uint num_plat;
     err = clGetPlatformIDs(0, NULL, &num_plat);
@@ -58,84 +404,453 @@ int init_cl(void) {
         return -1;
     }
 
-    cl_platform_id plat;
-    err = clGetPlatformIDs(1, &plat, NULL);
-    _if_err_ret("clGetPlatformIDs() failed");
+    cl_platform_id *plats = malloc(num_plat * sizeof(cl_platform_id));
+    if (NULL == plats) {
+        report_error("Out of memory");
+        return -1;
+    }
+
+    err = clGetPlatformIDs(num_plat, plats, NULL);
+    if (CL_SUCCESS != err) {
+        free(plats);
+        report_error_code("clGetPlatformIDs() failed", err);
+        return -1;
+    }
+
+    // Picks the first device of the requested type, e.g. CL_DEVICE_NOT_FOUND just means that the
+    // platform has none.
+    cl_uint num_dev = 0;
+    for (cl_uint i = 0; i < num_plat && 0 == num_dev; i++) {
+        if (CL_SUCCESS != clGetDeviceIDs(plats[i], type, 1, &de->device, &num_dev)) {
+            num_dev = 0;
+        }
+    }
+
+    free(plats);
 
-    cl_uint num_dev;
-    err = clGetDeviceIDs(plat, CL_DEVICE_TYPE_ALL, 1, &device, &num_dev);
-    _if_err_ret("clGetDeviceIDs() failed");
     if (0 == num_dev) {
         report_error("No devices available");
         return -1;
     }
 
-    context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
-    _if_err_ret("clCreateContext() failed");
-    queue = clCreateCommandQueueWithProperties(context, device, NULL, &err);
-    _if_err_ret("clCreateCommandQueueWithProperties() failed");
+    return create_queue(de);
+}
+
+// Lists the devices of all platforms, e.g. to run one island on each of them. If sub_units is
+// non-zero, devices that support it are partitioned into sub-devices of sub_units compute units
+// each. The devices have to be released with clReleaseDevice() (a no-op for root devices).
+int list_devices(unsigned sub_units, cl_device_id **devices, unsigned *num_devices) {
+    cl_int err;
+
+    *devices = NULL;
+    *num_devices = 0;
+
+    cl_uint num_plat;
+    err = clGetPlatformIDs(0, NULL, &num_plat);
+    _if_err_ret("clGetPlatformIDs() failed");
+
+    cl_platform_id *plats = malloc(num_plat * sizeof(cl_platform_id));
+    cl_device_id *roots = NULL;
+    cl_uint num_roots = 0;
+    int ok = 0;
+
+    if (NULL == plats) {
+        report_error("Out of memory");
+        goto __CleanUp;
+    }
+
+    err = clGetPlatformIDs(num_plat, plats, NULL);
+    _if_err_die("clGetPlatformIDs() failed");
+
+    for (cl_uint i = 0; i < num_plat; i++) {
+        // E.g. CL_DEVICE_NOT_FOUND for a platform without devices.
+        cl_uint num_dev;
+        if (CL_SUCCESS != clGetDeviceIDs(plats[i], CL_DEVICE_TYPE_ALL, 0, NULL, &num_dev)) {
+            continue;
+        }
+
+        cl_device_id *list = realloc(roots, (num_roots + num_dev) * sizeof(cl_device_id));
+        if (NULL == list) {
+            report_error("Out of memory");
+            goto __CleanUp;
+        }
+        roots = list;
+
+        err = clGetDeviceIDs(plats[i], CL_DEVICE_TYPE_ALL, num_dev, roots + num_roots, NULL);
+        _if_err_die("clGetDeviceIDs() failed");
+        num_roots += num_dev;
+    }
+
+    if (0 == num_roots) {
+        report_error("No devices available");
+        goto __CleanUp;
+    }
+
+    for (cl_uint i = 0; i < num_roots; i++) {
+        const cl_device_partition_property props[] = {
+            CL_DEVICE_PARTITION_EQUALLY, sub_units, 0
+        };
+
+        // Devices that cannot be partitioned (or only into a single part) are used as a whole.
+        cl_uint num_sub = 0;
+        if (0 != sub_units
+            && CL_SUCCESS != clCreateSubDevices(roots[i], props, 0, NULL, &num_sub)) {
+            num_sub = 0;
+        }
+
+        cl_device_id *list = realloc(*devices,
+            (*num_devices + (num_sub > 1 ? num_sub : 1)) * sizeof(cl_device_id));
+        if (NULL == list) {
+            report_error("Out of memory");
+            goto __CleanUp;
+        }
+        *devices = list;
+
+        if (num_sub > 1) {
+            err = clCreateSubDevices(roots[i], props, num_sub, list + *num_devices, NULL);
+            _if_err_die("clCreateSubDevices() failed");
+            *num_devices += num_sub;
+        } else {
+            list[(*num_devices)++] = roots[i];
+        }
+    }
+
+    ok = 1;
+
+__CleanUp:
+    free(plats);
+    free(roots);
+
+    if (!ok) {
+        for (unsigned i = 0; i < *num_devices; i++) {
+            clReleaseDevice((*devices)[i]);
+        }
+        free(*devices);
+        *devices = NULL;
+        *num_devices = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+void trace_span(diffevo_t *de, const char *name, unsigned tid, double start, double end) {
+    if (de->num_spans == de->cap_spans) {
+        const unsigned cap = 0 != de->cap_spans ? 2 * de->cap_spans : 256;
+        trace_span_t *spans = realloc(de->spans, cap * sizeof(trace_span_t));
+        if (NULL == spans) {
+            // The trace is best effort, the run itself is not affected.
+            return;
+        }
+        de->spans = spans;
+        de->cap_spans = cap;
+    }
+
+    trace_span_t *span = &de->spans[de->num_spans++];
+    span->name = name;
+    span->tid = tid;
+    span->start = start;
+    span->end = end;
+}
+
+// Adds the host time since start (see wall_time()) to a phase of the profile.
+void profile_phase(diffevo_t *de, unsigned phase, double start) {
+    if (!de->profiling) {
+        return;
+    }
+
+    const double end = wall_time();
+    de->profile.phases[phase] += end - start;
+
+    if (de->tracing) {
+        trace_span(de, phase_names[phase], 0, start, end);
+    }
+}
+
+// Keeps a reference to the event of a command, so that its device times can be queried once it
+// has finished.
+void profile_event(diffevo_t *de, unsigned type, cl_event evt) {
+    if (!de->profiling) {
+        return;
+    }
+
+    if (de->num_records == de->cap_records) {
+        const unsigned cap = 0 != de->cap_records ? 2 * de->cap_records : 256;
+        profile_record_t *records = realloc(de->records, cap * sizeof(profile_record_t));
+        if (NULL == records) {
+            return;
+        }
+        de->records = records;
+        de->cap_records = cap;
+    }
+
+    clRetainEvent(evt);
+
+    profile_record_t *r = &de->records[de->num_records++];
+    r->evt = evt;
+    r->type = type;
+    r->enqueued = wall_time();
+}
+
+// Accumulates the device times of all recorded commands, which must have finished, and releases
+// their events.
+void collect_profile(diffevo_t *de) {
+    const cl_profiling_info info[4] = {
+        CL_PROFILING_COMMAND_QUEUED, CL_PROFILING_COMMAND_SUBMIT, CL_PROFILING_COMMAND_START,
+        CL_PROFILING_COMMAND_END
+    };
+
+    for (unsigned i = 0; i < de->num_records; i++) {
+        const profile_record_t *r = &de->records[i];
+
+        cl_ulong t[4];
+        cl_int err = CL_SUCCESS;
+        for (unsigned j = 0; j < 4 && CL_SUCCESS == err; j++) {
+            err = clGetEventProfilingInfo(r->evt, info[j], sizeof(cl_ulong), &t[j], NULL);
+        }
+
+        clReleaseEvent(r->evt);
+
+        // E.g. a command that was aborted after an error.
+        if (CL_SUCCESS != err) {
+            continue;
+        }
+
+        diffevo_kernel_profile_t *k = &de->profile.kernels[r->type];
+        k->count++;
+        k->queued += (t[1] - t[0]) * 1e-9;
+        k->submitted += (t[2] - t[1]) * 1e-9;
+        k->executed += (t[3] - t[2]) * 1e-9;
+
+        // The device clock is not the host clock, but the queued time is the host time the
+        // command was enqueued at.
+        if (de->tracing) {
+            trace_span(de, kernel_names[r->type], 1, r->enqueued + (t[2] - t[0]) * 1e-9,
+                r->enqueued + (t[3] - t[0]) * 1e-9);
+        }
+    }
+
+    de->num_records = 0;
+}
+
+// Writes the spans of the given handles as Chrome trace (one process per handle), and clears them.
+int write_trace(const char *path, diffevo_t *const *handles, unsigned num_handles) {
+    FILE *fp = fopen(path, "w");
+    if (NULL == fp) {
+        report_error("Could not open trace file");
+        return -1;
+    }
+
+    double origin = INFINITY;
+    for (unsigned h = 0; h < num_handles; h++) {
+        for (unsigned i = 0; i < handles[h]->num_spans; i++) {
+            origin = fmin(origin, handles[h]->spans[i].start);
+        }
+    }
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+
+    for (unsigned h = 0; h < num_handles; h++) {
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":0,"
+            "\"args\":{\"name\":\"host\"}},\n", 0 != h ? ",\n" : "", h);
+        fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":1,"
+            "\"args\":{\"name\":\"device\"}}", h);
+
+        // Timestamps and durations in microseconds.
+        for (unsigned i = 0; i < handles[h]->num_spans; i++) {
+            const trace_span_t *span = &handles[h]->spans[i];
+            fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,"
+                "\"ts\":%.3f,\"dur\":%.3f}", span->name, h, span->tid,
+                (span->start - origin) * 1e6, (span->end - span->start) * 1e6);
+        }
+
+        handles[h]->num_spans = 0;
+    }
+
+    fprintf(fp, "\n]}\n");
+
+    if (0 != fclose(fp)) {
+        report_error("Could not write trace file");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Completes the profile of a run on the given handles (the islands or the handle itself), which
+// must have finished: sums it up into the statistics of de and writes the trace.
+int finish_profile(diffevo_t *de, const diffevo_params_t *params, diffevo_t *const *handles,
+    unsigned num_handles) {
+    diffevo_profile_t *sum = &de->stats.profile;
+    memset(sum, 0, sizeof(diffevo_profile_t));
+
+    for (unsigned h = 0; h < num_handles; h++) {
+        diffevo_t *d = handles[h];
+        collect_profile(d);
+
+        for (unsigned k = 0; k < DIFFEVO_NUM_KERNELS; k++) {
+            sum->kernels[k].count += d->profile.kernels[k].count;
+            sum->kernels[k].queued += d->profile.kernels[k].queued;
+            sum->kernels[k].submitted += d->profile.kernels[k].submitted;
+            sum->kernels[k].executed += d->profile.kernels[k].executed;
+        }
+        for (unsigned i = 0; i < DIFFEVO_NUM_PHASES; i++) {
+            sum->phases[i] += d->profile.phases[i];
+        }
+
+        memset(&d->profile, 0, sizeof(diffevo_profile_t));
+    }
+
+    if (de->tracing && NULL != params->profile_params.trace_path) {
+        return write_trace(params->profile_params.trace_path, handles, num_handles);
+    }
 
     return 0;
 }
 
-int destroy_cl(void) {
+int release_buffers(diffevo_t *de) {
     cl_int err;
 
-    if (NULL != buffers.rng) {
-        err = clReleaseMemObject(buffers.rng);
+    if (NULL != de->buffers.rng) {
+        err = clReleaseMemObject(de->buffers.rng);
+        _if_err_ret("clReleaseMemObject() failed");
+        de->buffers.rng = NULL;
+    }
+    if (NULL != de->buffers.seeds) {
+        err = clReleaseMemObject(de->buffers.seeds);
+        _if_err_ret("clReleaseMemObject() failed");
+        de->buffers.seeds = NULL;
+    }
+    if (NULL != de->buffers.dist) {
+        err = clReleaseMemObject(de->buffers.dist);
+        _if_err_ret("clReleaseMemObject() failed");
+        de->buffers.dist = NULL;
+    }
+    if (NULL != de->buffers.warm) {
+        err = clReleaseMemObject(de->buffers.warm);
         _if_err_ret("clReleaseMemObject() failed");
+        de->buffers.warm = NULL;
     }
-    if (NULL != buffers.seeds) {
-        err = clReleaseMemObject(buffers.seeds);
+    if (NULL != de->buffers.num_warm) {
+        err = clReleaseMemObject(de->buffers.num_warm);
         _if_err_ret("clReleaseMemObject() failed");
+        de->buffers.num_warm = NULL;
     }
 
     for (unsigned i = 0; i < 3; i++) {
-        if (NULL != buffers.pop[i]) {
-            err = clReleaseMemObject(buffers.pop[i]);
+        if (NULL != de->buffers.pop[i]) {
+            err = clReleaseMemObject(de->buffers.pop[i]);
             _if_err_ret("clReleaseMemObject() failed");
+            de->buffers.pop[i] = NULL;
         }
-        if (NULL != buffers.costs[i]) {
-            err = clReleaseMemObject(buffers.costs[i]);
+        if (NULL != de->buffers.costs[i]) {
+            err = clReleaseMemObject(de->buffers.costs[i]);
             _if_err_ret("clReleaseMemObject() failed");
+            de->buffers.costs[i] = NULL;
         }
     }
-    if (NULL != buffers.eval_data) {
-        err = clReleaseMemObject(buffers.eval_data);
+
+    if (NULL != de->buffers.status) {
+        err = clReleaseMemObject(de->buffers.status);
         _if_err_ret("clReleaseMemObject() failed");
+        de->buffers.status = NULL;
     }
-
-    if (NULL != kernels.init) {
-        err = clReleaseKernel(kernels.init);
-        _if_err_ret("clReleaseKernel() failed");
+    if (NULL != de->buffers.bounds) {
+        err = clReleaseMemObject(de->buffers.bounds);
+        _if_err_ret("clReleaseMemObject() failed");
+        de->buffers.bounds = NULL;
+    }
+    if (NULL != de->buffers.flags) {
+        err = clReleaseMemObject(de->buffers.flags);
+        _if_err_ret("clReleaseMemObject() failed");
+        de->buffers.flags = NULL;
+    }
+    if (NULL != de->buffers.ctrl) {
+        err = clReleaseMemObject(de->buffers.ctrl);
+        _if_err_ret("clReleaseMemObject() failed");
+        de->buffers.ctrl = NULL;
     }
-    if (NULL != kernels.eval) {
-        err = clReleaseKernel(kernels.eval);
-        _if_err_ret("clReleaseKernel() failed");
+    if (NULL != de->buffers.trial) {
+        err = clReleaseMemObject(de->buffers.trial);
+        _if_err_ret("clReleaseMemObject() failed");
+        de->buffers.trial = NULL;
+    }
+    if (NULL != de->buffers.saved) {
+        err = clReleaseMemObject(de->buffers.saved);
+        _if_err_ret("clReleaseMemObject() failed");
+        de->buffers.saved = NULL;
+    }
+    if (NULL != de->buffers.host_pop) {
+        err = clReleaseMemObject(de->buffers.host_pop);
+        _if_err_ret("clReleaseMemObject() failed");
+        de->buffers.host_pop = NULL;
     }
-    if (NULL != kernels.mutate) {
-        err = clReleaseKernel(kernels.mutate);
-        _if_err_ret("clReleaseKernel() failed");
+    if (NULL != de->buffers.host_costs) {
+        err = clReleaseMemObject(de->buffers.host_costs);
+        _if_err_ret("clReleaseMemObject() failed");
+        de->buffers.host_costs = NULL;
     }
-    if (NULL != kernels.select) {
-        err = clReleaseKernel(kernels.select);
-        _if_err_ret("clReleaseKernel() failed");
+
+    de->cap_problems = 0;
+    de->cap_members = 0;
+    de->cap_attr = 0;
+    de->cap_real = 0;
+
+    return 0;
+}
+
+int release_program(diffevo_t *de) {
+    cl_int err;
+
+    cl_kernel *all[] = {
+        &de->kernels.init, &de->kernels.eval, &de->kernels.mutate, &de->kernels.select,
+        &de->kernels.reduce, &de->kernels.mutate_2d, &de->kernels.select_2d,
+        &de->kernels.fused_eval, &de->kernels.generation, &de->kernels.generations,
+        &de->kernels.check_feasible, &de->kernels.adapt
+    };
+
+    for (unsigned i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+        if (NULL != *all[i]) {
+            err = clReleaseKernel(*all[i]);
+            _if_err_ret("clReleaseKernel() failed");
+            *all[i] = NULL;
+        }
     }
 
-    if (NULL != program) {
-        err = clReleaseProgram(program);
+    if (NULL != de->program) {
+        err = clReleaseProgram(de->program);
         _if_err_ret("clReleaseProgram() failed");
+        de->program = NULL;
+    }
+
+    return 0;
+}
+
+int destroy_cl(diffevo_t *de) {
+    cl_int err;
+
+    if (0 != release_buffers(de)) {
+        return -1;
+    }
+    if (NULL != de->buffers.eval_data) {
+        err = clReleaseMemObject(de->buffers.eval_data);
+        _if_err_ret("clReleaseMemObject() failed");
+    }
+
+    if (0 != release_program(de)) {
+        return -1;
     }
-    if (NULL != queue) {
-        err = clReleaseCommandQueue(queue);
+
+    if (NULL != de->queue) {
+        err = clReleaseCommandQueue(de->queue);
         _if_err_ret("clReleaseCommandQueue() failed");
     }
-    if (NULL != device) {
-        err = clReleaseDevice(device);
+    if (NULL != de->device) {
+        err = clReleaseDevice(de->device);
         _if_err_ret("clReleaseDevice() failed");
     }
-    if (NULL != context) {
-        err = clReleaseContext(context);
+    if (NULL != de->context) {
+        err = clReleaseContext(de->context);
         _if_err_ret("clReleaseContext() failed");
     }
 
@@ -183,367 +898,3499 @@ int read_file(const char *path, char **contents, size_t *length) {
     return 0;
 }
 
-int create_program(const char *eval_path) {
-    char *eval_src;
-    size_t eval_src_len;
+//
+// Program binary cache. Building the program from source can take hundreds of milliseconds (in
+// particular on CPU runtimes), so if a cache directory is set we store the device binary in there
+// and load it again on the next start. The file name is a hash over everything that influences
+// the binary: both sources, the build options and the identity of the device and its driver.
+//
 
-    if (0 != read_file(eval_path, &eval_src, &eval_src_len)) {
-        report_error("Failed to open eval() source file");
-        return -1;
+typedef unsigned long long hash_t;
+
+// 64-bit FNV-1a, which is more than enough to tell a handful of cached programs apart.
+hash_t hash_bytes(hash_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
     }
+    return h;
+}
 
+int hash_device_info(diffevo_t *de, cl_device_info param, hash_t *h) {
     cl_int err;
 
-    //
-    // Compile both sources (DE algorithm and user-defined eval()) into one program.
-    //
+    size_t len;
+    err = clGetDeviceInfo(de->device, param, 0, NULL, &len);
+    _if_err_ret("clGetDeviceInfo() failed");
 
-    const char *srcs[2];
-    size_t lens[2];
+    char *info = malloc(len);
+    if (NULL == info) {
+        report_error("Out of memory");
+        return -1;
+    }
 
-    srcs[0] = eval_src;
-    lens[0] = eval_src_len;
-    srcs[1] = algo_src;
-    lens[1] = strlen(algo_src);
+    err = clGetDeviceInfo(de->device, param, len, info, NULL);
+    if (CL_SUCCESS != err) {
+        free(info);
+        report_error_code("clGetDeviceInfo() failed", err);
+        return -1;
+    }
 
-    program = clCreateProgramWithSource(context, 2, srcs, lens, &err);
-    free(eval_src);
-    eval_src = NULL;
-    _if_err_ret("clCreateProgramWithSource() failed");
+    *h = hash_bytes(*h, info, len);
+    free(info);
 
-    err = clBuildProgram(program, 1, &device, NULL, NULL, NULL);
-    if (CL_SUCCESS != err) {
-        if (CL_BUILD_PROGRAM_FAILURE != err) {
-            report_error("clBuildProgram() failed without a build failure");
-            return -1;
-        }
+    return 0;
+}
 
-        //
-        // In case of a program build error, read and print the build log to the user.
-        //
+// Collects the sources the program consists of, in order. Returns the number of sources.
+unsigned program_sources(diffevo_t *de, const char **srcs, size_t *lens) {
+    unsigned n = 0;
 
-        size_t log_len;
-        err = clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_len);
-        _if_err_ret("clGetProgramBuildInfo() failed");
-        char *log = malloc(log_len);
-        if (NULL == log) {
-            report_error("Out of memory");
-            return -1;
-        }
+    srcs[n] = algo_defs;
+    lens[n++] = strlen(algo_defs);
 
-        err = clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_len, log, NULL);
-        _if_err_ret("clGetProgramBuildInfo() failed");
-        if (CL_SUCCESS != err) {
-            free(log);
-            log = NULL;
-            return -1;
-        }
+    // Without an eval() kernel, the costs are evaluated by the host.
+    if (NULL != de->eval_src) {
+        srcs[n] = de->eval_src;
+        lens[n++] = de->eval_src_len;
+    }
 
-        report_error(log);
-        free(log);
-        log = NULL;
+    srcs[n] = algo_src;
+    lens[n++] = strlen(algo_src);
 
-        return -1;
+    if (de->fused) {
+        srcs[n] = fused_src;
+        lens[n++] = strlen(fused_src);
+    }
+
+    if (de->feasible) {
+        srcs[n] = feasible_src;
+        lens[n++] = strlen(feasible_src);
+    }
+
+    return n;
+}
+
+int cache_file_path(diffevo_t *de, const char *options, char *path, size_t path_len) {
+    hash_t h = 0xcbf29ce484222325ull;
+
+    const char *srcs[MAX_SOURCES];
+    size_t lens[MAX_SOURCES];
+    const unsigned num_srcs = program_sources(de, srcs, lens);
+
+    for (unsigned i = 0; i < num_srcs; i++) {
+        h = hash_bytes(h, srcs[i], lens[i]);
+        h = hash_bytes(h, "", 1);
+    }
+    h = hash_bytes(h, options, strlen(options) + 1);
+
+    if (0 != hash_device_info(de, CL_DEVICE_NAME, &h)
+        || 0 != hash_device_info(de, CL_DEVICE_VENDOR, &h)
+        || 0 != hash_device_info(de, CL_DEVICE_VERSION, &h)
+        || 0 != hash_device_info(de, CL_DRIVER_VERSION, &h)) {
+        return -1;
+    }
+
+    const int len = snprintf(path, path_len, "%s/diffevo-%016llx.bin", de->cache_dir, h);
+    if (len < 0 || (size_t) len >= path_len) {
+        report_error("Cache directory path too long");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Tries to create and build the program from a cached binary. Any failure (missing file, binary
+// rejected by the driver, ...) is not an error but simply means we have to build from source.
+int load_cached_program(diffevo_t *de, const char *path, const char *options) {
+    char *bin;
+    size_t bin_len;
+
+    if (0 != read_file(path, &bin, &bin_len)) {
+        return -1;
+    }
+
+    cl_int err, bin_status;
+    const unsigned char *bins[1] = { (const unsigned char *) bin };
+
+    de->program = clCreateProgramWithBinary(de->context, 1, &de->device, &bin_len, bins,
+        &bin_status, &err);
+    free(bin);
+    bin = NULL;
+
+    if (CL_SUCCESS != err || CL_SUCCESS != bin_status) {
+        if (NULL != de->program) {
+            clReleaseProgram(de->program);
+            de->program = NULL;
+        }
+        return -1;
+    }
+
+    err = clBuildProgram(de->program, 1, &de->device, options, NULL, NULL);
+    if (CL_SUCCESS != err) {
+        clReleaseProgram(de->program);
+        de->program = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+// Stores the binary of the freshly built program. Failing to do so only costs us the next build,
+// so errors are silently ignored.
+void store_cached_program(diffevo_t *de, const char *path) {
+    cl_int err;
+
+    size_t bin_len;
+    err = clGetProgramInfo(de->program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &bin_len, NULL);
+    if (CL_SUCCESS != err || 0 == bin_len) {
+        return;
+    }
+
+    unsigned char *bin = malloc(bin_len);
+    if (NULL == bin) {
+        return;
+    }
+
+    unsigned char *bins[1] = { bin };
+    err = clGetProgramInfo(de->program, CL_PROGRAM_BINARIES, sizeof(bins), bins, NULL);
+    if (CL_SUCCESS != err) {
+        free(bin);
+        return;
+    }
+
+    // Write to a temporary file first, so that a concurrently starting process never reads a
+    // partially written binary.
+    char tmp_path[FILENAME_MAX];
+    const int len = snprintf(tmp_path, sizeof(tmp_path), "%s.%u.tmp", path, random_seed());
+    if (len < 0 || (size_t) len >= sizeof(tmp_path)) {
+        free(bin);
+        return;
+    }
+
+    _mkdir(de->cache_dir);
+
+    FILE *fp = fopen(tmp_path, "wb");
+    if (NULL == fp) {
+        free(bin);
+        return;
+    }
+
+    const size_t written = fwrite(bin, 1, bin_len, fp);
+    free(bin);
+    bin = NULL;
+
+    if (0 != fclose(fp) || written != bin_len
+        || !MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING)) {
+        remove(tmp_path);
+    }
+}
+
+void report_build_log(diffevo_t *de) {
+    cl_int err;
+
+    size_t log_len;
+    err = clGetProgramBuildInfo(de->program, de->device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_len);
+    if (CL_SUCCESS != err) {
+        report_error_code("clGetProgramBuildInfo() failed", err);
+        return;
+    }
+
+    char *log = malloc(log_len);
+    if (NULL == log) {
+        report_error("Out of memory");
+        return;
+    }
+
+    err = clGetProgramBuildInfo(de->program, de->device, CL_PROGRAM_BUILD_LOG, log_len, log,
+        NULL);
+    if (CL_SUCCESS != err) {
+        report_error_code("clGetProgramBuildInfo() failed", err);
+    } else {
+        report_error(log);
+    }
+
+    free(log);
+    log = NULL;
+}
+
+int build_program(diffevo_t *de, const char *options) {
+    cl_int err;
+
+    char path[FILENAME_MAX];
+    const int cached = NULL != de->cache_dir && 0 == cache_file_path(de, options, path,
+        sizeof(path));
+
+    if (cached && 0 == load_cached_program(de, path, options)) {
+        return 0;
+    }
+
+    //
+    // Compile all sources (DE algorithm and user-defined eval()) into one program.
+    //
+
+    const char *srcs[MAX_SOURCES];
+    size_t lens[MAX_SOURCES];
+    const unsigned num_srcs = program_sources(de, srcs, lens);
+
+    de->program = clCreateProgramWithSource(de->context, num_srcs, srcs, lens, &err);
+    _if_err_ret("clCreateProgramWithSource() failed");
+
+    err = clBuildProgram(de->program, 1, &de->device, options, NULL, NULL);
+    if (CL_SUCCESS != err) {
+        if (CL_BUILD_PROGRAM_FAILURE != err) {
+            report_error("clBuildProgram() failed without a build failure");
+            return -1;
+        }
+
+        // In case of a program build error, read and print the build log to the user.
+        report_build_log(de);
+
+        return -1;
+    }
+
+    if (cached) {
+        store_cached_program(de, path);
+    }
+
+    return 0;
+}
+
+int load_program_source(diffevo_t *de, const char *eval_path, const char *cache_dir) {
+    if (NULL != eval_path && 0 != read_file(eval_path, &de->eval_src, &de->eval_src_len)) {
+        report_error("Failed to open eval() source file");
+        return -1;
+    }
+
+    if (NULL != cache_dir) {
+        de->cache_dir = malloc(strlen(cache_dir) + 1);
+        if (NULL == de->cache_dir) {
+            report_error("Out of memory");
+            return -1;
+        }
+        strcpy(de->cache_dir, cache_dir);
+    }
+
+    return 0;
+}
+
+int create_kernels(diffevo_t *de) {
+    cl_int err;
+
+    de->kernels.init = clCreateKernel(de->program, "init", &err);
+    _if_err_ret("Failed to create init() kernel");
+    de->kernels.reduce = clCreateKernel(de->program, "reduce", &err);
+    _if_err_ret("Failed to create reduce() kernel");
+    de->kernels.adapt = clCreateKernel(de->program, "adapt", &err);
+    _if_err_ret("Failed to create adapt() kernel");
+
+    if (de->fused) {
+        de->kernels.fused_eval = clCreateKernel(de->program, "fused_eval", &err);
+        _if_err_ret("Failed to create fused_eval() kernel");
+        de->kernels.generation = clCreateKernel(de->program, "generation", &err);
+        _if_err_ret("Failed to create generation() kernel");
+        de->kernels.generations = clCreateKernel(de->program, "generations", &err);
+        _if_err_ret("Failed to create generations() kernel");
+    } else {
+        if (!de->host_eval) {
+            de->kernels.eval = clCreateKernel(de->program, "eval", &err);
+            _if_err_ret("Failed to create eval() kernel");
+        }
+        // The feasible variants only append arguments, so that they can take the place of
+        // mutate() and select().
+        de->kernels.mutate = clCreateKernel(de->program,
+            de->feasible ? "mutate_feasible" : "mutate", &err);
+        _if_err_ret("Failed to create mutate() kernel");
+        de->kernels.select = clCreateKernel(de->program,
+            de->feasible ? "select_feasible" : "select", &err);
+        _if_err_ret("Failed to create select() kernel");
+        de->kernels.mutate_2d = clCreateKernel(de->program, "mutate_2d", &err);
+        _if_err_ret("Failed to create mutate_2d() kernel");
+        de->kernels.select_2d = clCreateKernel(de->program, "select_2d", &err);
+        _if_err_ret("Failed to create select_2d() kernel");
+    }
+
+    // Fused mode needs it as well, for the initial members with known costs.
+    if (de->feasible) {
+        de->kernels.check_feasible = clCreateKernel(de->program, "check_feasible", &err);
+        _if_err_ret("Failed to create check_feasible() kernel");
+    }
+
+    return 0;
+}
+
+// Number of members of all problems of the current run.
+size_t num_members(const diffevo_t *de, const diffevo_params_t *params) {
+    return (size_t) de->num_problems * params->num_pop;
+}
+
+// Number of members the population buffers need to be allocated for, see POP_ALIGN.
+unsigned num_members_aligned(const diffevo_t *de, const diffevo_params_t *params) {
+    return (de->num_problems * params->num_pop + POP_ALIGN - 1) / POP_ALIGN * POP_ALIGN;
+}
+
+// Distance in bytes between the eval data slices of two problems. A single problem uses the data
+// as it is, no matter its size.
+unsigned data_stride(const diffevo_t *de, const diffevo_params_t *params) {
+    const unsigned size = params->eval_params.const_data_size;
+    return de->num_problems > 1 ? (size + DATA_ALIGN - 1) / DATA_ALIGN * DATA_ALIGN : size;
+}
+
+// Size of a real_t of the kernels, see precision.
+size_t real_size(const diffevo_params_t *params) {
+    return DIFFEVO_PRECISION_FLOAT == params->precision ? sizeof(cl_float) : sizeof(cl_double);
+}
+
+// Converts n reals read back from the device to doubles. Works in place, i.e. dst may be src.
+void reals_to_doubles(double *dst, const void *src, size_t n, size_t real) {
+    if (sizeof(cl_double) == real) {
+        memmove(dst, src, n * sizeof(double));
+        return;
+    }
+
+    // Backwards, since the doubles take up more space than the floats they are converted from.
+    for (size_t i = n; i-- > 0;) {
+        dst[i] = ((const cl_float *) src)[i];
+    }
+}
+
+// Converts n doubles to reals for the device. Works in place, i.e. dst may be src.
+void doubles_to_reals(void *dst, const double *src, size_t n, size_t real) {
+    if (sizeof(cl_double) == real) {
+        memmove(dst, src, n * sizeof(double));
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        ((cl_float *) dst)[i] = (cl_float) src[i];
+    }
+}
+
+// Sets a real_t kernel argument, see precision.
+cl_int set_real_arg(cl_kernel kernel, cl_uint index, const diffevo_params_t *params,
+    double value) {
+    if (DIFFEVO_PRECISION_FLOAT == params->precision) {
+        const cl_float f = (cl_float) value;
+        return clSetKernelArg(kernel, index, sizeof(cl_float), &f);
+    }
+
+    return clSetKernelArg(kernel, index, sizeof(cl_double), &value);
+}
+
+// Checks whether all read-only kernel arguments fit into the constant address space of the device.
+// The largest consumers are select() (two populations and their costs) and eval() (a population
+// and the eval data), so we conservatively require all of them to fit at the same time.
+int fits_constant(diffevo_t *de, const diffevo_params_t *params) {
+    cl_ulong max_size;
+    cl_uint max_args;
+
+    if (CL_SUCCESS != clGetDeviceInfo(de->device, CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE,
+        sizeof(cl_ulong), &max_size, NULL)
+        || CL_SUCCESS != clGetDeviceInfo(de->device, CL_DEVICE_MAX_CONSTANT_ARGS,
+        sizeof(cl_uint), &max_args, NULL)) {
+        return 0;
+    }
+
+    const cl_ulong members = num_members_aligned(de, params);
+    const cl_ulong pop_size = members * params->num_attr * real_size(params);
+    const cl_ulong cost_size = members * real_size(params);
+    const cl_ulong eval_size = (cl_ulong) data_stride(de, params) * de->num_problems;
+
+    // With Philox, the seeds are read by every generation.
+    const cl_ulong seed_size = DIFFEVO_RNG_PHILOX == params->rng ? members * sizeof(unsigned) : 0;
+
+    // The bounds, and the feasibility flags select_feasible() reads.
+    const cl_ulong bound_size = 2 * params->num_attr * real_size(params) + members;
+
+    return max_args >= 5
+        && 2 * pop_size + 2 * cost_size + eval_size + seed_size + bound_size <= max_size;
+}
+
+// Appends a formatted option to the (always zero-terminated) build options.
+void append_option(char *options, size_t options_len, const char *fmt, ...) {
+    const size_t len = strlen(options);
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(options + len, options_len - len, fmt, args);
+    va_end(args);
+}
+
+int build_options(diffevo_t *de, const diffevo_params_t *params, char *options,
+    size_t options_len) {
+    cl_int err;
+
+    options[0] = '\0';
+
+    if (NULL == params) {
+        return 0;
+    }
+
+    if (params->specialize) {
+        // Bake the parameters that stay fixed during a whole solve into the program, so that the
+        // compiler can unroll the per-attribute loops and replace the modulo by a constant.
+        // The doubles are printed with enough digits to round-trip exactly.
+        append_option(options, options_len,
+            "-D DIFFEVO_NUM_POP=%u -D DIFFEVO_NUM_ATTR=%u -D DIFFEVO_SHRINK=%.17g "
+            "-D DIFFEVO_CROSSOVER=%.17g ",
+            params->num_pop, params->num_attr, params->shrink, params->crossover);
+    }
+
+    if (params->fused) {
+        append_option(options, options_len, "-D DIFFEVO_FUSED ");
+    }
+
+    if (params->constraint_params.feasible) {
+        append_option(options, options_len, "-D DIFFEVO_FEASIBLE ");
+    }
+
+    if ((params->fused || params->constraint_params.feasible) && !params->specialize) {
+        // The fused and feasible kernels keep the trial vector in private memory, which needs a
+        // fixed size.
+        append_option(options, options_len, "-D DIFFEVO_NUM_ATTR=%u ", params->num_attr);
+    }
+
+    if (NULL != params->constraint_params.lower) {
+        append_option(options, options_len, "-D DIFFEVO_BOUNDS=%u ",
+            params->constraint_params.repair);
+    }
+
+    if (DIFFEVO_LAYOUT_SOA == params->layout) {
+        // Pad the rows to the native vector width, so that they all start aligned.
+        cl_uint width;
+        err = clGetDeviceInfo(de->device, DIFFEVO_PRECISION_FLOAT == params->precision
+            ? CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT : CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE,
+            sizeof(cl_uint), &width, NULL);
+        _if_err_ret("clGetDeviceInfo() failed");
+
+        if (0 == width || POP_ALIGN % width != 0) {
+            width = 1;
+        }
+
+        append_option(options, options_len, "-D DIFFEVO_SOA=%u ", width);
+    }
+
+    if (DIFFEVO_RNG_PHILOX == params->rng) {
+        append_option(options, options_len, "-D DIFFEVO_PHILOX ");
+    }
+
+    if (params->force_mutant) {
+        append_option(options, options_len, "-D DIFFEVO_FORCE_MUTANT ");
+    }
+
+    if (DIFFEVO_STRATEGY_RAND_1 != params->strategy) {
+        append_option(options, options_len, "-D DIFFEVO_STRATEGY=%u ", params->strategy);
+    }
+
+    if (DIFFEVO_ADAPT_NONE != params->adapt_params.mode) {
+        append_option(options, options_len, "-D DIFFEVO_ADAPT=%u -D DIFFEVO_MEMORY=%u ",
+            params->adapt_params.mode, memory_size(params));
+    }
+
+    if (DIFFEVO_PRECISION_FLOAT == params->precision) {
+        // Literals like 0.5 would otherwise be doubles, which devices without double precision
+        // support reject (and the others compute slowly).
+        append_option(options, options_len, "-D DIFFEVO_FLOAT -cl-single-precision-constant ");
+    } else {
+        cl_device_fp_config fp64 = 0;
+        err = clGetDeviceInfo(de->device, CL_DEVICE_DOUBLE_FP_CONFIG,
+            sizeof(cl_device_fp_config), &fp64, NULL);
+        _if_err_ret("clGetDeviceInfo() failed");
+
+        if (0 == fp64) {
+            report_error("The device does not support double precision, use "
+                "DIFFEVO_PRECISION_FLOAT");
+            return -1;
+        }
+    }
+
+    if (NULL != params->cost_fn) {
+        // Only changes the set of kernels, see create_kernels().
+        append_option(options, options_len, "-D DIFFEVO_HOST_EVAL ");
+    }
+
+    if (de->num_problems > 1) {
+        append_option(options, options_len, "-D DIFFEVO_DATA_STRIDE=%u ",
+            data_stride(de, params));
+    }
+
+    if (!fits_constant(de, params)) {
+        append_option(options, options_len, "-D DIFFEVO_GLOBAL_CONST ");
+    }
+
+    return 0;
+}
+
+// Makes sure the program and its kernels are built with the options required by the parameters.
+// Nothing is done if this is already the case, otherwise the program is rebuilt (which is cheap,
+// if the binary cache is enabled).
+int prepare_program(diffevo_t *de, const diffevo_params_t *params) {
+    char options[MAX_OPTIONS_LEN];
+    if (0 != build_options(de, params, options, sizeof(options))) {
+        return -1;
+    }
+
+    if (NULL != de->program && 0 == strcmp(options, de->options)) {
+        return 0;
+    }
+
+    if (0 != release_program(de)) {
+        return -1;
+    }
+
+    de->fused = NULL != params && params->fused;
+    de->philox = NULL != params && DIFFEVO_RNG_PHILOX == params->rng;
+    de->feasible = NULL != params && params->constraint_params.feasible;
+    de->host_eval = NULL != params && NULL != params->cost_fn;
+
+    if (0 != build_program(de, options) || 0 != create_kernels(de)) {
+        // Do not leave a half-built program behind, the next run would otherwise assume it to be
+        // up to date.
+        report_error("Error while loading program");
+        release_program(de);
+        return -1;
+    }
+
+    strcpy(de->options, options);
+
+    return 0;
+}
+
+int alloc_buffers(diffevo_t *de, const diffevo_params_t *params,
+    const diffevo_problem_t *problems) {
+    cl_int err;
+
+    const unsigned req_members = num_members_aligned(de, params);
+
+    if (de->num_problems > de->cap_problems || req_members > de->cap_members
+        || params->num_attr > de->cap_attr || real_size(params) > de->cap_real) {
+        // Never shrink in either dimension, so that alternating shapes (e.g. many members with
+        // few attributes and vice versa) do not cause a reallocation on every run.
+        const unsigned num_problems = de->num_problems > de->cap_problems ? de->num_problems
+            : de->cap_problems;
+        const unsigned members = req_members > de->cap_members ? req_members : de->cap_members;
+        const unsigned num_attr = params->num_attr > de->cap_attr ? params->num_attr
+            : de->cap_attr;
+        const size_t real = real_size(params) > de->cap_real ? real_size(params) : de->cap_real;
+
+        if (0 != release_buffers(de)) {
+            return -1;
+        }
+
+        //
+        // Use one RNG per population member. A finer granularity does not make sense, because
+        // the overhead would be too high (since mutation and crossover is rather quick), and a
+        // coarser granularity would drastically decrease the parallelism (would not be per
+        // member anymore).
+        //
+
+        de->buffers.rng = clCreateBuffer(de->context, CL_MEM_READ_WRITE, members * 0x10, NULL,
+            &err);
+        _if_err_ret("clCreateBuffer() failed");
+
+        de->buffers.seeds = clCreateBuffer(de->context, CL_MEM_READ_ONLY,
+            members * sizeof(unsigned), NULL, &err);
+        _if_err_ret("clCreateBuffer() failed");
+
+        // Initial distribution, i.e. (mu, sigma) per problem, and the number of given initial
+        // members per problem.
+        de->buffers.dist = clCreateBuffer(de->context, CL_MEM_READ_ONLY,
+            num_problems * 2 * real, NULL, &err);
+        _if_err_ret("clCreateBuffer() failed");
+        de->buffers.num_warm = clCreateBuffer(de->context, CL_MEM_READ_ONLY,
+            num_problems * sizeof(cl_uint), NULL, &err);
+        _if_err_ret("clCreateBuffer() failed");
+
+        //
+        // Use three population and cost buffers, so that we can select() from two into one
+        // separate. Altough increasing the memory consumption, it allows to make the input
+        // buffers cacheable.
+        //
+
+        for (unsigned i = 0; i < 3; i++) {
+            de->buffers.pop[i] = clCreateBuffer(de->context, CL_MEM_READ_WRITE,
+                (size_t) members * num_attr * real, NULL, &err);
+            _if_err_ret("clCreateBuffer() failed");
+            de->buffers.costs[i] = clCreateBuffer(de->context, CL_MEM_READ_WRITE,
+                members * real, NULL, &err);
+            _if_err_ret("clCreateBuffer() failed");
+        }
+
+        // Small buffer the reduce() kernel writes the status of every problem into: maximum cost,
+        // minimum cost, index of the best member and its attributes. The mutation strategies that
+        // use the best member read it from there.
+        de->buffers.status = clCreateBuffer(de->context, CL_MEM_READ_WRITE,
+            (size_t) num_problems * (3 + num_attr) * real, NULL, &err);
+        _if_err_ret("clCreateBuffer() failed");
+
+        de->buffers.bounds = clCreateBuffer(de->context, CL_MEM_READ_ONLY, 2 * num_attr * real,
+            NULL, &err);
+        _if_err_ret("clCreateBuffer() failed");
+        de->buffers.flags = clCreateBuffer(de->context, CL_MEM_READ_WRITE, members, NULL, &err);
+        _if_err_ret("clCreateBuffer() failed");
+        de->buffers.saved = clCreateBuffer(de->context, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL,
+            &err);
+        _if_err_ret("clCreateBuffer() failed");
+
+        // The SHADE memory of all problems fits as well, since memory_size is at most num_pop,
+        // followed by the next entry of every problem.
+        de->buffers.ctrl = clCreateBuffer(de->context, CL_MEM_READ_WRITE,
+            (members * 2 + num_problems) * real, NULL, &err);
+        _if_err_ret("clCreateBuffer() failed");
+        de->buffers.trial = clCreateBuffer(de->context, CL_MEM_READ_WRITE, members * 3 * real,
+            NULL, &err);
+        _if_err_ret("clCreateBuffer() failed");
+
+        de->cap_problems = num_problems;
+        de->cap_members = members;
+        de->cap_attr = num_attr;
+        de->cap_real = real;
+    }
+
+    if (de->host_eval && NULL == de->buffers.host_pop) {
+        // Allocated in host memory, so that mapping them does not involve another copy.
+        de->buffers.host_pop = clCreateBuffer(de->context,
+            CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+            (size_t) de->cap_members * de->cap_attr * sizeof(double), NULL, &err);
+        _if_err_ret("clCreateBuffer() failed");
+        de->buffers.host_costs = clCreateBuffer(de->context,
+            CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, de->cap_members * sizeof(double), NULL,
+            &err);
+        _if_err_ret("clCreateBuffer() failed");
+    }
+
+    int warm = 0;
+    for (unsigned p = 0; p < de->num_problems; p++) {
+        warm |= 0 != problems[p].num_init;
+    }
+
+    if (warm && NULL == de->buffers.warm) {
+        de->buffers.warm = clCreateBuffer(de->context, CL_MEM_READ_ONLY,
+            (size_t) de->cap_members * de->cap_attr * de->cap_real, NULL, &err);
+        _if_err_ret("clCreateBuffer() failed");
+    }
+
+    if (de->host_eval) {
+        // The host evaluates the costs with the application memory directly.
+        return 0;
+    }
+
+    //
+    // If the user wishes, we copy their data into a read-only buffer, so it can be used
+    // during eval(). This could be for example some dynamic parameters. The buffer is kept
+    // across runs and only refilled, unless the data has grown. With zero_copy set, the buffer
+    // uses the application memory directly instead (and is recreated whenever it changes). A
+    // batch stores the data of every problem in its own slice.
+    //
+
+    int has_data = 0;
+    for (unsigned i = 0; i < de->num_problems; i++) {
+        has_data |= NULL != problems[i].const_data_ptr;
+    }
+
+    const void *eval_ptr = has_data ? problems[0].const_data_ptr : NULL;
+    const unsigned stride = data_stride(de, params);
+    const unsigned eval_size = stride * de->num_problems;
+    const int zero_copy = NULL != eval_ptr && params->eval_params.zero_copy;
+
+    const int recreate = zero_copy
+        ? de->eval_data_host != eval_ptr || de->cap_eval_data != eval_size
+        : NULL != de->eval_data_host || (has_data && eval_size > de->cap_eval_data);
+
+    if (recreate && NULL != de->buffers.eval_data) {
+        err = clReleaseMemObject(de->buffers.eval_data);
+        _if_err_ret("clReleaseMemObject() failed");
+        de->buffers.eval_data = NULL;
+        de->eval_data_host = NULL;
+        de->cap_eval_data = 0;
+    }
+
+    if (zero_copy) {
+        if (NULL == de->buffers.eval_data) {
+            de->buffers.eval_data = clCreateBuffer(de->context,
+                CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, eval_size, (void *) eval_ptr, &err);
+            _if_err_ret("clCreateBuffer() failed");
+            de->eval_data_host = eval_ptr;
+            de->cap_eval_data = eval_size;
+        }
+    } else if (has_data) {
+        if (NULL == de->buffers.eval_data) {
+            de->buffers.eval_data = clCreateBuffer(de->context, CL_MEM_READ_ONLY, eval_size,
+                NULL, &err);
+            _if_err_ret("clCreateBuffer() failed");
+            de->cap_eval_data = eval_size;
+        }
+
+        for (unsigned i = 0; i < de->num_problems; i++) {
+            if (NULL == problems[i].const_data_ptr) {
+                continue;
+            }
+
+            // Blocking: the caller may free or reuse the data as soon as we return.
+            err = clEnqueueWriteBuffer(de->queue, de->buffers.eval_data, CL_TRUE, i * stride,
+                params->eval_params.const_data_size, problems[i].const_data_ptr, 0, NULL, NULL);
+            _if_err_ret("clEnqueueWriteBuffer() failed");
+        }
+    }
+
+    return 0;
+}
+
+// The single problem described by the parameters themselves.
+diffevo_problem_t params_problem(const diffevo_params_t *params) {
+    diffevo_problem_t problem = { 0 };
+    problem.const_data_ptr = params->eval_params.const_data_ptr;
+    problem.mu = params->mu;
+    problem.sigma = params->sigma;
+    problem.init_pop = params->init_params.pop;
+    problem.num_init = params->init_params.num_members;
+    problem.init_costs = params->init_params.costs;
+    problem.seed = params->seed;
+    return problem;
+}
+
+// Creates a handle with its own context, queue, program and buffers on the given device, NULL
+// for the default device.
+int create_handle(const char *path, const diffevo_params_t *params, cl_device_id device,
+    diffevo_t **de) {
+    int err;
+
+    diffevo_t *h = calloc(1, sizeof(diffevo_t));
+    if (NULL == h) {
+        report_error("Out of memory");
+        return -1;
+    }
+
+    h->num_problems = 1;
+    h->backend = DIFFEVO_BACKEND_OPENCL;
+    h->device_type = NULL != params ? params->device_type : DIFFEVO_DEVICE_ANY;
+    h->profiling = NULL != params && params->profile_params.enabled;
+    h->tracing = h->profiling && NULL != params->profile_params.trace_path;
+
+    double start = wall_time();
+
+    err = init_cl(h, device);
+    if (0 != err) {
+        report_error("Error while creating OpenCL context");
+        goto __CleanUp;
+    }
+
+    profile_phase(h, DIFFEVO_PHASE_CONTEXT, start);
+    start = wall_time();
+
+    err = load_program_source(h, path, NULL != params ? params->cache_dir : NULL);
+    if (0 != err) {
+        report_error("Error while loading program");
+        goto __CleanUp;
+    }
+
+    err = prepare_program(h, params);
+    if (0 != err) {
+        goto __CleanUp;
+    }
+
+    profile_phase(h, DIFFEVO_PHASE_BUILD, start);
+    start = wall_time();
+
+    if (NULL != params) {
+        const diffevo_problem_t problem = params_problem(params);
+        err = alloc_buffers(h, params, &problem);
+        if (0 != err) {
+            goto __CleanUp;
+        }
+    }
+
+    profile_phase(h, DIFFEVO_PHASE_SETUP, start);
+
+    *de = h;
+    return 0;
+
+__CleanUp:
+
+    diffevo_release(h);
+    return -1;
+}
+
+// Creates a handle for the island model, which creates one handle per island on the devices of
+// all platforms, see island_params.
+int create_islands(const char *path, const diffevo_params_t *params, diffevo_t **de) {
+    const unsigned num_islands = params->island_params.num_islands;
+
+    diffevo_t *h = calloc(1, sizeof(diffevo_t));
+    if (NULL == h) {
+        report_error("Out of memory");
+        return -1;
+    }
+
+    h->num_problems = 1;
+    h->backend = DIFFEVO_BACKEND_OPENCL;
+
+    h->profiling = params->profile_params.enabled;
+    h->tracing = h->profiling && NULL != params->profile_params.trace_path;
+
+    h->islands = calloc(num_islands, sizeof(diffevo_t *));
+    if (NULL == h->islands) {
+        free(h);
+        report_error("Out of memory");
+        return -1;
+    }
+    h->num_islands = num_islands;
+
+    cl_device_id *devices;
+    unsigned num_devices;
+    if (0 != list_devices(params->island_params.sub_device_units, &devices, &num_devices)) {
+        diffevo_release(h);
+        return -1;
+    }
+
+    // More islands than devices share them, each with its own context and queue.
+    int err = 0;
+    for (unsigned i = 0; i < num_islands && 0 == err; i++) {
+        err = create_handle(path, params, devices[i % num_devices], &h->islands[i]);
+    }
+
+    // The islands keep their own references to the devices.
+    for (unsigned i = 0; i < num_devices; i++) {
+        clReleaseDevice(devices[i]);
+    }
+    free(devices);
+
+    if (0 != err) {
+        diffevo_release(h);
+        return -1;
+    }
+
+    *de = h;
+    return 0;
+}
+
+int diffevo_create(const char *path, const diffevo_params_t *params, diffevo_t **de) {
+    const unsigned backend = NULL != params ? params->backend : DIFFEVO_BACKEND_OPENCL;
+
+    if (NULL == path && DIFFEVO_BACKEND_OPENCL == backend
+        && (NULL == params || NULL == params->cost_fn)) {
+        report_error("eval() path not specified");
+        return -1;
+    }
+    if (NULL == de) {
+        report_error("Handle pointer not specified");
+        return -1;
+    }
+
+    last_error = 0;
+    *de = NULL;
+
+    if (DIFFEVO_BACKEND_NATIVE == backend) {
+        // Everything else is allocated by the first run.
+        diffevo_t *h = calloc(1, sizeof(diffevo_t));
+        if (NULL == h) {
+            report_error("Out of memory");
+            return -1;
+        }
+
+        h->num_problems = 1;
+        h->backend = backend;
+
+        *de = h;
+        return 0;
+    }
+
+    if (NULL != params && params->island_params.num_islands > 1) {
+        return create_islands(path, params, de);
+    }
+
+    return create_handle(path, params, NULL, de);
+}
+
+int diffevo_release(diffevo_t *de) {
+    if (NULL == de) {
+        return 0;
+    }
+    if (0 != de->busy) {
+        report_error("The handle is busy with another run");
+        return -1;
+    }
+
+    int err = destroy_cl(de);
+    native_release(de->native);
+
+    for (unsigned i = 0; i < de->num_islands; i++) {
+        if (NULL != de->islands[i] && 0 != diffevo_release(de->islands[i])) {
+            err = -1;
+        }
+    }
+    free(de->islands);
+
+    for (unsigned i = 0; i < de->num_records; i++) {
+        clReleaseEvent(de->records[i].evt);
+    }
+    free(de->records);
+    free(de->spans);
+
+    free(de->eval_src);
+    free(de->cache_dir);
+    free(de);
+
+    if (0 != err) {
+        report_error("Error while destroying OpenCL context");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Makes evt the predecessor of the next command. The previous event can be released right away,
+// as the runtime keeps it alive until completion.
+void set_last(cl_event *last, cl_event evt) {
+    if (NULL != *last) {
+        clReleaseEvent(*last);
+    }
+    *last = evt;
+}
+
+// Type of a kernel in the profile, see DIFFEVO_KERNEL_*.
+unsigned kernel_type(const diffevo_t *de, cl_kernel kernel) {
+    if (kernel == de->kernels.init) {
+        return DIFFEVO_KERNEL_INIT;
+    }
+    if (kernel == de->kernels.eval || kernel == de->kernels.check_feasible) {
+        return DIFFEVO_KERNEL_EVAL;
+    }
+    if (kernel == de->kernels.mutate || kernel == de->kernels.mutate_2d) {
+        return DIFFEVO_KERNEL_MUTATE;
+    }
+    if (kernel == de->kernels.select || kernel == de->kernels.select_2d
+        || kernel == de->kernels.adapt) {
+        return DIFFEVO_KERNEL_SELECT;
+    }
+    if (kernel == de->kernels.reduce) {
+        return DIFFEVO_KERNEL_REDUCE;
+    }
+    if (kernel == de->kernels.generations) {
+        return DIFFEVO_KERNEL_PERSISTENT;
+    }
+    return DIFFEVO_KERNEL_FUSED;
+}
+
+// Enqueues a kernel behind the previously enqueued command and makes it the new predecessor.
+cl_int enqueue_after_nd(diffevo_t *de, cl_kernel kernel, cl_uint dim, const size_t *glb_work,
+    const size_t *loc_work, cl_event *last) {
+    cl_event evt;
+
+    const cl_int err = clEnqueueNDRangeKernel(de->queue, kernel, dim, NULL, glb_work, loc_work,
+        NULL != *last ? 1 : 0, NULL != *last ? last : NULL, &evt);
+    if (CL_SUCCESS != err) {
+        return err;
+    }
+
+    profile_event(de, kernel_type(de, kernel), evt);
+    set_last(last, evt);
+
+    return CL_SUCCESS;
+}
+
+cl_int enqueue_after(diffevo_t *de, cl_kernel kernel, size_t glb_work, const size_t *loc_work,
+    cl_event *last) {
+    return enqueue_after_nd(de, kernel, 1, &glb_work, loc_work, last);
+}
+
+// Buffer passed as rng argument: the TinyMT32 states, or the seeds if they key Philox.
+const cl_mem *rng_buffer(const diffevo_t *de) {
+    return de->philox ? &de->buffers.seeds : &de->buffers.rng;
+}
+
+int enqueue_init(diffevo_t *de, const diffevo_params_t *params, cl_event *last) {
+    cl_int err;
+
+    err = clSetKernelArg(de->kernels.init, 0, sizeof(cl_mem), rng_buffer(de));
+    _if_err_ret("init!clSetKernelArg(0) failed");
+    err = clSetKernelArg(de->kernels.init, 1, sizeof(cl_mem), &de->buffers.seeds);
+    _if_err_ret("init!clSetKernelArg(1) failed");
+    err = clSetKernelArg(de->kernels.init, 2, sizeof(cl_mem), &de->buffers.pop[0]);
+    _if_err_ret("init!clSetKernelArg(2) failed");
+    err = clSetKernelArg(de->kernels.init, 3, sizeof(cl_uint), &params->num_pop);
+    _if_err_ret("init!clSetKernelArg(3) failed");
+    err = clSetKernelArg(de->kernels.init, 4, sizeof(cl_uint), &params->num_attr);
+    _if_err_ret("init!clSetKernelArg(4) failed");
+    err = clSetKernelArg(de->kernels.init, 5, sizeof(cl_mem), &de->buffers.dist);
+    _if_err_ret("init!clSetKernelArg(5) failed");
+    err = clSetKernelArg(de->kernels.init, 6, sizeof(cl_mem), &de->buffers.bounds);
+    _if_err_ret("init!clSetKernelArg(6) failed");
+    err = clSetKernelArg(de->kernels.init, 7, sizeof(cl_mem), &de->buffers.warm);
+    _if_err_ret("init!clSetKernelArg(7) failed");
+    err = clSetKernelArg(de->kernels.init, 8, sizeof(cl_mem), &de->buffers.num_warm);
+    _if_err_ret("init!clSetKernelArg(8) failed");
+
+    err = enqueue_after(de, de->kernels.init, num_members(de, params), NULL, last);
+    _if_err_ret("init!clEnqueueNDRangeKernel() failed");
+
+    return 0;
+}
+
+// Number of chunks in which the host evaluates the members, see enqueue_host_eval().
+#define HOST_EVAL_CHUNKS 4
+
+unsigned num_known_costs(const diffevo_problem_t *problems, unsigned num_problems) {
+    unsigned known = 0;
+    for (unsigned p = 0; p < num_problems; p++) {
+        known += NULL != problems[p].init_costs ? problems[p].num_init : 0;
+    }
+    return known;
+}
+
+// Number of initial members of the current run that are not evaluated, since their costs are
+// known. An eval() kernel with a local_work_size evaluates them anyway, see enqueue_eval().
+unsigned num_skipped_init(const diffevo_t *de, const diffevo_params_t *params) {
+    if (!params->fused && !de->host_eval && 0 < params->eval_params.local_work_size) {
+        return 0;
+    }
+    return num_known_costs(de->problems, de->num_problems);
+}
+
+// Marks the members of the initial population whose costs are not known in advance, i.e. all but
+// the given initial members with init_costs. mask receives NULL if all of them are unknown.
+int unknown_costs(const diffevo_t *de, const diffevo_params_t *params, unsigned char **mask) {
+    *mask = NULL;
+
+    if (0 == num_known_costs(de->problems, de->num_problems)) {
+        return 0;
+    }
+
+    const size_t members = num_members(de, params);
+
+    *mask = malloc(members);
+    if (NULL == *mask) {
+        report_error("Out of memory");
+        return -1;
+    }
+    memset(*mask, 1, members);
+
+    for (unsigned p = 0; p < de->num_problems; p++) {
+        if (NULL != de->problems[p].init_costs) {
+            memset(*mask + (size_t) p * params->num_pop, 0, de->problems[p].num_init);
+        }
+    }
+
+    return 0;
+}
+
+// Enqueues kernel for the members first to end - 1 (none, if end is not past first), with a global
+// work offset.
+cl_int enqueue_range(diffevo_t *de, cl_kernel kernel, size_t first, size_t end, cl_event *last) {
+    if (end <= first) {
+        return CL_SUCCESS;
+    }
+
+    const size_t count = end - first;
+    cl_event evt;
+
+    const cl_int err = clEnqueueNDRangeKernel(de->queue, kernel, 1, &first, &count, NULL,
+        NULL != *last ? 1 : 0, NULL != *last ? last : NULL, &evt);
+    if (CL_SUCCESS != err) {
+        return err;
+    }
+
+    profile_event(de, kernel_type(de, kernel), evt);
+    set_last(last, evt);
+
+    return CL_SUCCESS;
+}
+
+// Enqueues kernel for the members of the initial population whose costs are not known in advance,
+// see unknown_costs(), i.e. for the members between the known ones of consecutive problems. The
+// kernel has to identify its member by get_global_id(0), which includes the offset.
+cl_int enqueue_unknown_costs(diffevo_t *de, const diffevo_params_t *params, cl_kernel kernel,
+    cl_event *last) {
+    size_t first = 0;
+
+    for (unsigned p = 0; p < de->num_problems; p++) {
+        const unsigned known = NULL != de->problems[p].init_costs ? de->problems[p].num_init : 0;
+        if (0 == known) {
+            continue;
+        }
+
+        const size_t start = (size_t) p * params->num_pop;
+        const cl_int err = enqueue_range(de, kernel, first, start, last);
+        if (CL_SUCCESS != err) {
+            return err;
+        }
+        first = start + known;
+    }
+
+    return enqueue_range(de, kernel, first, num_members(de, params), last);
+}
+
+// Evaluates population p with cost_fn on the host. The members are copied into the pinned staging
+// buffer and mapped in chunks, all enqueued up front, so that the transfer of a chunk overlaps
+// with the evaluation of the previous one. Likewise, the costs of a chunk are unmapped and copied
+// back while the host evaluates the next one. For the trial population (p = 1), the flags of
+// mutate() are mapped as well, and the trials that equal their parent are skipped. For the initial
+// population, the given initial members with known costs are skipped.
+int enqueue_host_eval(diffevo_t *de, const diffevo_params_t *params, unsigned p,
+    cl_event *last) {
+    cl_int err = CL_SUCCESS;
+
+    const size_t members = num_members(de, params);
+    const size_t row = params->num_attr * sizeof(double);
+    const size_t chunk = (members + HOST_EVAL_CHUNKS - 1) / HOST_EVAL_CHUNKS;
+
+    unsigned char *unknown = NULL;
+    if (0 == p && 0 != unknown_costs(de, params, &unknown)) {
+        return -1;
+    }
+
+    double *pop_ptr[HOST_EVAL_CHUNKS] = { NULL };
+    double *cost_ptr[HOST_EVAL_CHUNKS] = { NULL };
+    unsigned char *flag_ptr[HOST_EVAL_CHUNKS] = { NULL };
+    cl_event mapped[HOST_EVAL_CHUNKS] = { NULL };
+    cl_event evt;
+
+    for (unsigned k = 0; k < HOST_EVAL_CHUNKS && k * chunk < members; k++) {
+        const size_t first = k * chunk;
+        const size_t count = members - first < chunk ? members - first : chunk;
+
+        err = clEnqueueCopyBuffer(de->queue, de->buffers.pop[p], de->buffers.host_pop,
+            first * row, first * row, count * row, NULL != *last ? 1 : 0,
+            NULL != *last ? last : NULL, &evt);
+        _if_err_die("clEnqueueCopyBuffer() failed");
+        profile_event(de, DIFFEVO_KERNEL_TRANSFER, evt);
+        set_last(last, evt);
+
+        cost_ptr[k] = clEnqueueMapBuffer(de->queue, de->buffers.host_costs, CL_FALSE,
+            CL_MAP_WRITE_INVALIDATE_REGION, first * sizeof(double), count * sizeof(double),
+            1, last, &evt, &err);
+        _if_err_die("clEnqueueMapBuffer() failed");
+        profile_event(de, DIFFEVO_KERNEL_TRANSFER, evt);
+        set_last(last, evt);
+
+        if (1 == p) {
+            flag_ptr[k] = clEnqueueMapBuffer(de->queue, de->buffers.flags, CL_FALSE, CL_MAP_READ,
+                first, count, 1, last, &evt, &err);
+            _if_err_die("clEnqueueMapBuffer() failed");
+            profile_event(de, DIFFEVO_KERNEL_TRANSFER, evt);
+            set_last(last, evt);
+        }
+
+        pop_ptr[k] = clEnqueueMapBuffer(de->queue, de->buffers.host_pop, CL_FALSE, CL_MAP_READ,
+            first * row, count * row, 1, last, &mapped[k], &err);
+        _if_err_die("clEnqueueMapBuffer() failed");
+        clRetainEvent(mapped[k]);
+        profile_event(de, DIFFEVO_KERNEL_TRANSFER, mapped[k]);
+        set_last(last, mapped[k]);
+    }
+
+    // Make sure the device starts on the transfers while we wait for the first chunk.
+    clFlush(de->queue);
+
+    for (unsigned k = 0; k < HOST_EVAL_CHUNKS && NULL != mapped[k]; k++) {
+        const size_t first = k * chunk;
+        const size_t count = members - first < chunk ? members - first : chunk;
+
+        err = clWaitForEvents(1, &mapped[k]);
+        _if_err_die("clWaitForEvents() failed");
+
+        const double start = wall_time();
+        if (NULL != unknown) {
+            // The costs of the skipped members are replaced by upload_warm_costs() afterwards.
+            native_eval(params, de->problems, pop_ptr[k], unknown + first, cost_ptr[k],
+                (unsigned) first, (unsigned) count);
+        } else {
+            de->stats.num_evals_saved += native_eval(params, de->problems, pop_ptr[k],
+                flag_ptr[k], cost_ptr[k], (unsigned) first, (unsigned) count);
+        }
+        profile_phase(de, DIFFEVO_PHASE_HOST_EVAL, start);
+
+        if (NULL != flag_ptr[k]) {
+            err = clEnqueueUnmapMemObject(de->queue, de->buffers.flags, flag_ptr[k],
+                1, last, &evt);
+            _if_err_die("clEnqueueUnmapMemObject() failed");
+            profile_event(de, DIFFEVO_KERNEL_TRANSFER, evt);
+            set_last(last, evt);
+            flag_ptr[k] = NULL;
+        }
+
+        err = clEnqueueUnmapMemObject(de->queue, de->buffers.host_pop, pop_ptr[k],
+            1, last, &evt);
+        _if_err_die("clEnqueueUnmapMemObject() failed");
+        profile_event(de, DIFFEVO_KERNEL_TRANSFER, evt);
+        set_last(last, evt);
+        pop_ptr[k] = NULL;
+
+        err = clEnqueueUnmapMemObject(de->queue, de->buffers.host_costs, cost_ptr[k],
+            1, last, &evt);
+        _if_err_die("clEnqueueUnmapMemObject() failed");
+        profile_event(de, DIFFEVO_KERNEL_TRANSFER, evt);
+        set_last(last, evt);
+        cost_ptr[k] = NULL;
+
+        err = clEnqueueCopyBuffer(de->queue, de->buffers.host_costs, de->buffers.costs[p],
+            first * sizeof(double), first * sizeof(double), count * sizeof(double), 1, last,
+            &evt);
+        _if_err_die("clEnqueueCopyBuffer() failed");
+        profile_event(de, DIFFEVO_KERNEL_TRANSFER, evt);
+        set_last(last, evt);
+
+        clFlush(de->queue);
+    }
+
+__CleanUp:
+
+    for (unsigned k = 0; k < HOST_EVAL_CHUNKS; k++) {
+        // Regions still mapped after an error.
+        if (NULL != pop_ptr[k]) {
+            clEnqueueUnmapMemObject(de->queue, de->buffers.host_pop, pop_ptr[k], 0, NULL, NULL);
+        }
+        if (NULL != cost_ptr[k]) {
+            clEnqueueUnmapMemObject(de->queue, de->buffers.host_costs, cost_ptr[k], 0, NULL,
+                NULL);
+        }
+        if (NULL != flag_ptr[k]) {
+            clEnqueueUnmapMemObject(de->queue, de->buffers.flags, flag_ptr[k], 0, NULL, NULL);
+        }
+        if (NULL != mapped[k]) {
+            clReleaseEvent(mapped[k]);
+        }
+    }
+
+    free(unknown);
+
+    return CL_SUCCESS == err ? 0 : -1;
+}
+
+int enqueue_eval(diffevo_t *de, const diffevo_params_t *params, unsigned p, cl_event *last) {
+    cl_int err;
+
+    if (de->host_eval) {
+        return enqueue_host_eval(de, params, p, last);
+    }
+
+    err = clSetKernelArg(de->kernels.eval, 0, sizeof(cl_mem), &de->buffers.pop[p]);
+    _if_err_ret("eval!clSetKernelArg(0) failed");
+    err = clSetKernelArg(de->kernels.eval, 1, sizeof(cl_mem), &de->buffers.costs[p]);
+    _if_err_ret("eval!clSetKernelArg(1) failed");
+    err = clSetKernelArg(de->kernels.eval, 2, sizeof(cl_uint), &params->num_pop);
+    _if_err_ret("eval!clSetKernelArg(2) failed");
+    err = clSetKernelArg(de->kernels.eval, 3, sizeof(cl_uint), &params->num_attr);
+    _if_err_ret("eval!clSetKernelArg(3) failed");
+    err = clSetKernelArg(de->kernels.eval, 4, sizeof(cl_mem), &de->buffers.eval_data);
+    _if_err_ret("eval!clSetKernelArg(4) failed");
+    err = clSetKernelArg(de->kernels.eval, 5, params->eval_params.local_data_size, NULL);
+    _if_err_ret("eval!clSetKernelArg(5) failed");
+
+    size_t eval_glb_work, eval_loc_work;
+    size_t *eval_loc_work_ptr;
+
+    if (0 < params->eval_params.local_work_size) {
+        // The user explicitly set the number of work groups that are used per population member.
+        // The global work is picked so that for every population member we have as much eval()
+        // calls (in parallel) as the user chose.
+        // TODO: Notify the user if the number of work group exceeds hardware limitations.
+        eval_loc_work = params->eval_params.local_work_size;
+        eval_loc_work_ptr = &eval_loc_work;
+        eval_glb_work = eval_loc_work * num_members(de, params);
+    } else {
+        // Passing NULL as local_work_size tells the compiler find the ideal number of work groups.
+        // Note, that the global work is reduced, because eval() is called only once per member.
+        eval_loc_work_ptr = NULL;
+        eval_glb_work = num_members(de, params);
+
+        // The work groups of a local_work_size are identified by get_group_id(0), which does not
+        // include a global work offset, so only then the known initial costs can be skipped.
+        if (0 == p) {
+            err = enqueue_unknown_costs(de, params, de->kernels.eval, last);
+            _if_err_ret("eval!clEnqueueNDRangeKernel() failed");
+            return 0;
+        }
+    }
+
+    err = enqueue_after(de, de->kernels.eval, eval_glb_work, eval_loc_work_ptr, last);
+    _if_err_ret("eval!clEnqueueNDRangeKernel() failed");
+
+    return 0;
+}
+
+int enqueue_fused_eval(diffevo_t *de, const diffevo_params_t *params, unsigned p,
+    cl_event *last) {
+    cl_int err;
+
+    err = clSetKernelArg(de->kernels.fused_eval, 0, sizeof(cl_mem), &de->buffers.pop[p]);
+    _if_err_ret("fused_eval!clSetKernelArg(0) failed");
+    err = clSetKernelArg(de->kernels.fused_eval, 1, sizeof(cl_mem), &de->buffers.costs[p]);
+    _if_err_ret("fused_eval!clSetKernelArg(1) failed");
+    err = clSetKernelArg(de->kernels.fused_eval, 2, sizeof(cl_uint), &params->num_pop);
+    _if_err_ret("fused_eval!clSetKernelArg(2) failed");
+    err = clSetKernelArg(de->kernels.fused_eval, 3, sizeof(cl_uint), &params->num_attr);
+    _if_err_ret("fused_eval!clSetKernelArg(3) failed");
+    err = clSetKernelArg(de->kernels.fused_eval, 4, sizeof(cl_mem), &de->buffers.eval_data);
+    _if_err_ret("fused_eval!clSetKernelArg(4) failed");
+
+    err = 0 == p ? enqueue_unknown_costs(de, params, de->kernels.fused_eval, last)
+        : enqueue_after(de, de->kernels.fused_eval, num_members(de, params), NULL, last);
+    _if_err_ret("fused_eval!clEnqueueNDRangeKernel() failed");
+
+    return 0;
+}
+
+// Gives the infeasible members of population p an infinite cost, once it has been evaluated.
+int enqueue_check_feasible(diffevo_t *de, const diffevo_params_t *params, unsigned p,
+    cl_event *last) {
+    cl_int err;
+
+    err = clSetKernelArg(de->kernels.check_feasible, 0, sizeof(cl_mem), &de->buffers.pop[p]);
+    _if_err_ret("check_feasible!clSetKernelArg(0) failed");
+    err = clSetKernelArg(de->kernels.check_feasible, 1, sizeof(cl_mem), &de->buffers.costs[p]);
+    _if_err_ret("check_feasible!clSetKernelArg(1) failed");
+    err = clSetKernelArg(de->kernels.check_feasible, 2, sizeof(cl_uint), &params->num_pop);
+    _if_err_ret("check_feasible!clSetKernelArg(2) failed");
+    err = clSetKernelArg(de->kernels.check_feasible, 3, sizeof(cl_uint), &params->num_attr);
+    _if_err_ret("check_feasible!clSetKernelArg(3) failed");
+    err = clSetKernelArg(de->kernels.check_feasible, 4, sizeof(cl_mem),
+        &de->buffers.eval_data);
+    _if_err_ret("check_feasible!clSetKernelArg(4) failed");
+
+    err = enqueue_after(de, de->kernels.check_feasible, num_members(de, params), NULL, last);
+    _if_err_ret("check_feasible!clEnqueueNDRangeKernel() failed");
+
+    return 0;
+}
+
+// Enqueues the reduction of population p, which determines the cost range and the best member of
+// every problem.
+int enqueue_reduce(diffevo_t *de, const diffevo_params_t *params, unsigned p, cl_event *last) {
+    cl_int err;
+
+    size_t max_work;
+    err = clGetKernelWorkGroupInfo(de->kernels.reduce, de->device, CL_KERNEL_WORK_GROUP_SIZE,
+        sizeof(size_t), &max_work, NULL);
+    _if_err_ret("clGetKernelWorkGroupInfo() failed");
+
+    // The tree reduction needs a power of two, more than 256 work items do not pay off for the
+    // population sizes DE is used with.
+    size_t loc_work = 1;
+    while (loc_work * 2 <= max_work && loc_work * 2 <= 256 && loc_work < params->num_pop) {
+        loc_work *= 2;
+    }
+
+    err = clSetKernelArg(de->kernels.reduce, 0, sizeof(cl_mem), &de->buffers.pop[p]);
+    _if_err_ret("reduce!clSetKernelArg(0) failed");
+    err = clSetKernelArg(de->kernels.reduce, 1, sizeof(cl_mem), &de->buffers.costs[p]);
+    _if_err_ret("reduce!clSetKernelArg(1) failed");
+    err = clSetKernelArg(de->kernels.reduce, 2, sizeof(cl_mem), &de->buffers.status);
+    _if_err_ret("reduce!clSetKernelArg(2) failed");
+    err = clSetKernelArg(de->kernels.reduce, 3, sizeof(cl_uint), &params->num_pop);
+    _if_err_ret("reduce!clSetKernelArg(3) failed");
+    err = clSetKernelArg(de->kernels.reduce, 4, sizeof(cl_uint), &params->num_attr);
+    _if_err_ret("reduce!clSetKernelArg(4) failed");
+    err = clSetKernelArg(de->kernels.reduce, 5, loc_work * real_size(params), NULL);
+    _if_err_ret("reduce!clSetKernelArg(5) failed");
+    err = clSetKernelArg(de->kernels.reduce, 6, loc_work * real_size(params), NULL);
+    _if_err_ret("reduce!clSetKernelArg(6) failed");
+    err = clSetKernelArg(de->kernels.reduce, 7, loc_work * sizeof(cl_uint), NULL);
+    _if_err_ret("reduce!clSetKernelArg(7) failed");
+
+    err = enqueue_after(de, de->kernels.reduce, loc_work * de->num_problems, &loc_work, last);
+    _if_err_ret("reduce!clEnqueueNDRangeKernel() failed");
+
+    return 0;
+}
+
+// Enqueues the update of the SHADE memory after a generation, see adapt().
+int enqueue_adapt(diffevo_t *de, const diffevo_params_t *params, cl_event *last) {
+    cl_int err;
+
+    err = clSetKernelArg(de->kernels.adapt, 0, sizeof(cl_mem), &de->buffers.ctrl);
+    _if_err_ret("adapt!clSetKernelArg(0) failed");
+    err = clSetKernelArg(de->kernels.adapt, 1, sizeof(cl_mem), &de->buffers.trial);
+    _if_err_ret("adapt!clSetKernelArg(1) failed");
+    err = clSetKernelArg(de->kernels.adapt, 2, sizeof(cl_uint), &params->num_pop);
+    _if_err_ret("adapt!clSetKernelArg(2) failed");
+
+    err = enqueue_after(de, de->kernels.adapt, de->num_problems, NULL, last);
+    _if_err_ret("adapt!clEnqueueNDRangeKernel() failed");
+
+    return 0;
+}
+
+// Number of attributes from which on mutate() and select() are parallelized over the attributes
+// as well, unless the user chose a different threshold.
+#define HIGH_DIM_ATTR 512
+
+int is_high_dim(const diffevo_params_t *params) {
+    if (params->constraint_params.feasible) {
+        // feasible() needs the whole trial vector in one work item.
+        return 0;
+    }
+    if (DIFFEVO_ADAPT_NONE != params->adapt_params.mode) {
+        // The control parameters of a trial are drawn per member, the 2D variants do not pass
+        // them on.
+        return 0;
+    }
+
+    const unsigned threshold = 0 != params->high_dim_attr ? params->high_dim_attr
+        : HIGH_DIM_ATTR;
+    return params->num_attr >= threshold;
+}
+
+// Enqueues a kernel with one work group per member, whose work items share the attributes.
+cl_int enqueue_after_2d(diffevo_t *de, const diffevo_params_t *params, cl_kernel kernel,
+    cl_event *last) {
+    size_t max_work;
+    const cl_int err = clGetKernelWorkGroupInfo(kernel, de->device, CL_KERNEL_WORK_GROUP_SIZE,
+        sizeof(size_t), &max_work, NULL);
+    if (CL_SUCCESS != err) {
+        return err;
+    }
+
+    // More than 128 work items per member only add scheduling overhead, the attributes are
+    // simply strided over the work items of the group.
+    size_t tile = params->num_attr < 128 ? params->num_attr : 128;
+    if (tile > max_work) {
+        tile = max_work;
+    }
+
+    const size_t glb_work[2] = { tile, num_members(de, params) };
+    const size_t loc_work[2] = { tile, 1 };
+
+    return enqueue_after_nd(de, kernel, 2, glb_work, loc_work, last);
+}
+
+// Enqueues one generation as mutate(), eval() and select() from population p_cand into p_res,
+// using the remaining buffer (1) for the trial population. For many attributes, the 2D variants
+// of mutate() and select() are used. Depending on the strategy and the adaptation, reduce() runs
+// before and adapt() after.
+int enqueue_generation(diffevo_t *de, const diffevo_params_t *params, unsigned gen,
+    unsigned p_cand, unsigned p_res, cl_event *last) {
+    cl_int err;
+
+    const int high_dim = is_high_dim(params);
+    const cl_kernel mutate_k = high_dim ? de->kernels.mutate_2d : de->kernels.mutate;
+    const cl_kernel select_k = high_dim ? de->kernels.select_2d : de->kernels.select;
+
+    if (uses_best(params) && 0 != enqueue_reduce(de, params, p_cand, last)) {
+        return -1;
+    }
+
+    //
+    // Mutate the population.
+    //
+
+    err = clSetKernelArg(mutate_k, 0, sizeof(cl_mem), rng_buffer(de));
+    _if_err_ret("mutate!clSetKernelArg(0) failed");
+    err = clSetKernelArg(mutate_k, 1, sizeof(cl_mem), &de->buffers.pop[p_cand]);
+    _if_err_ret("mutate!clSetKernelArg(1) failed");
+    err = clSetKernelArg(mutate_k, 2, sizeof(cl_mem), &de->buffers.pop[1]);
+    _if_err_ret("mutate!clSetKernelArg(2) failed");
+    err = clSetKernelArg(mutate_k, 3, sizeof(cl_uint), &params->num_pop);
+    _if_err_ret("mutate!clSetKernelArg(3) failed");
+    err = clSetKernelArg(mutate_k, 4, sizeof(cl_uint), &params->num_attr);
+    _if_err_ret("mutate!clSetKernelArg(4) failed");
+    err = set_real_arg(mutate_k, 5, params, params->shrink);
+    _if_err_ret("mutate!clSetKernelArg(5) failed");
+    err = set_real_arg(mutate_k, 6, params, params->crossover);
+    _if_err_ret("mutate!clSetKernelArg(6) failed");
+    err = clSetKernelArg(mutate_k, 7, sizeof(cl_uint), &gen);
+    _if_err_ret("mutate!clSetKernelArg(7) failed");
+    err = clSetKernelArg(mutate_k, 8, sizeof(cl_mem), &de->buffers.bounds);
+    _if_err_ret("mutate!clSetKernelArg(8) failed");
+
+    err = clSetKernelArg(mutate_k, 9, sizeof(cl_mem), &de->buffers.flags);
+    _if_err_ret("mutate!clSetKernelArg(9) failed");
+    err = clSetKernelArg(mutate_k, 10, sizeof(cl_mem), &de->buffers.status);
+    _if_err_ret("mutate!clSetKernelArg(10) failed");
+
+    if (!high_dim) {
+        err = clSetKernelArg(mutate_k, 11, sizeof(cl_mem), &de->buffers.ctrl);
+        _if_err_ret("mutate!clSetKernelArg(11) failed");
+        err = clSetKernelArg(mutate_k, 12, sizeof(cl_mem), &de->buffers.trial);
+        _if_err_ret("mutate!clSetKernelArg(12) failed");
+    }
+
+    if (de->feasible) {
+        err = clSetKernelArg(mutate_k, 13, sizeof(cl_mem), &de->buffers.eval_data);
+        _if_err_ret("mutate!clSetKernelArg(13) failed");
+    }
+
+    err = high_dim ? enqueue_after_2d(de, params, mutate_k, last)
+        : enqueue_after(de, mutate_k, num_members(de, params), NULL, last);
+    _if_err_ret("mutate!clEnqueueNDRangeKernel() failed");
+
+    //
+    // Evaluate the mutated population.
+    //
+
+    if (0 != enqueue_eval(de, params, 1, last)) {
+        return -1;
+    }
+
+    //
+    // Select the better members out of both populations.
+    //
+
+    err = clSetKernelArg(select_k, 0, sizeof(cl_mem), &de->buffers.pop[p_cand]);
+    _if_err_ret("select!clSetKernelArg(0) failed");
+    err = clSetKernelArg(select_k, 1, sizeof(cl_mem), &de->buffers.costs[p_cand]);
+    _if_err_ret("select!clSetKernelArg(1) failed");
+    err = clSetKernelArg(select_k, 2, sizeof(cl_mem), &de->buffers.pop[1]);
+    _if_err_ret("select!clSetKernelArg(2) failed");
+    err = clSetKernelArg(select_k, 3, sizeof(cl_mem), &de->buffers.costs[1]);
+    _if_err_ret("select!clSetKernelArg(3) failed");
+    err = clSetKernelArg(select_k, 4, sizeof(cl_mem), &de->buffers.pop[p_res]);
+    _if_err_ret("select!clSetKernelArg(4) failed");
+    err = clSetKernelArg(select_k, 5, sizeof(cl_mem), &de->buffers.costs[p_res]);
+    _if_err_ret("select!clSetKernelArg(5) failed");
+    err = clSetKernelArg(select_k, 6, sizeof(cl_uint), &params->num_pop);
+    _if_err_ret("select!clSetKernelArg(6) failed");
+    err = clSetKernelArg(select_k, 7, sizeof(cl_uint), &params->num_attr);
+    _if_err_ret("select!clSetKernelArg(7) failed");
+
+    if (!high_dim) {
+        err = clSetKernelArg(select_k, 8, sizeof(cl_mem), &de->buffers.ctrl);
+        _if_err_ret("select!clSetKernelArg(8) failed");
+        err = clSetKernelArg(select_k, 9, sizeof(cl_mem), &de->buffers.trial);
+        _if_err_ret("select!clSetKernelArg(9) failed");
+    }
+
+    if (de->feasible) {
+        err = clSetKernelArg(select_k, 10, sizeof(cl_mem), &de->buffers.flags);
+        _if_err_ret("select!clSetKernelArg(10) failed");
+    }
+
+    err = high_dim ? enqueue_after_2d(de, params, select_k, last)
+        : enqueue_after(de, select_k, num_members(de, params), NULL, last);
+    _if_err_ret("select!clEnqueueNDRangeKernel() failed");
+
+    if (DIFFEVO_ADAPT_SHADE == params->adapt_params.mode
+        && 0 != enqueue_adapt(de, params, last)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Enqueues one generation as a single generation() kernel from population p_cand into p_res.
+int enqueue_fused_generation(diffevo_t *de, const diffevo_params_t *params, unsigned gen,
+    unsigned p_cand, unsigned p_res, cl_event *last) {
+    cl_int err;
+
+    if (uses_best(params) && 0 != enqueue_reduce(de, params, p_cand, last)) {
+        return -1;
+    }
+
+    err = clSetKernelArg(de->kernels.generation, 0, sizeof(cl_mem), rng_buffer(de));
+    _if_err_ret("generation!clSetKernelArg(0) failed");
+    err = clSetKernelArg(de->kernels.generation, 1, sizeof(cl_mem), &de->buffers.pop[p_cand]);
+    _if_err_ret("generation!clSetKernelArg(1) failed");
+    err = clSetKernelArg(de->kernels.generation, 2, sizeof(cl_mem), &de->buffers.costs[p_cand]);
+    _if_err_ret("generation!clSetKernelArg(2) failed");
+    err = clSetKernelArg(de->kernels.generation, 3, sizeof(cl_mem), &de->buffers.pop[p_res]);
+    _if_err_ret("generation!clSetKernelArg(3) failed");
+    err = clSetKernelArg(de->kernels.generation, 4, sizeof(cl_mem), &de->buffers.costs[p_res]);
+    _if_err_ret("generation!clSetKernelArg(4) failed");
+    err = clSetKernelArg(de->kernels.generation, 5, sizeof(cl_uint), &params->num_pop);
+    _if_err_ret("generation!clSetKernelArg(5) failed");
+    err = clSetKernelArg(de->kernels.generation, 6, sizeof(cl_uint), &params->num_attr);
+    _if_err_ret("generation!clSetKernelArg(6) failed");
+    err = set_real_arg(de->kernels.generation, 7, params, params->shrink);
+    _if_err_ret("generation!clSetKernelArg(7) failed");
+    err = set_real_arg(de->kernels.generation, 8, params, params->crossover);
+    _if_err_ret("generation!clSetKernelArg(8) failed");
+    err = clSetKernelArg(de->kernels.generation, 9, sizeof(cl_mem), &de->buffers.eval_data);
+    _if_err_ret("generation!clSetKernelArg(9) failed");
+    err = clSetKernelArg(de->kernels.generation, 10, sizeof(cl_uint), &gen);
+    _if_err_ret("generation!clSetKernelArg(10) failed");
+    err = clSetKernelArg(de->kernels.generation, 11, sizeof(cl_mem), &de->buffers.bounds);
+    _if_err_ret("generation!clSetKernelArg(11) failed");
+    err = clSetKernelArg(de->kernels.generation, 12, sizeof(cl_mem), &de->buffers.saved);
+    _if_err_ret("generation!clSetKernelArg(12) failed");
+    err = clSetKernelArg(de->kernels.generation, 13, sizeof(cl_mem), &de->buffers.status);
+    _if_err_ret("generation!clSetKernelArg(13) failed");
+    err = clSetKernelArg(de->kernels.generation, 14, sizeof(cl_mem), &de->buffers.ctrl);
+    _if_err_ret("generation!clSetKernelArg(14) failed");
+    err = clSetKernelArg(de->kernels.generation, 15, sizeof(cl_mem), &de->buffers.trial);
+    _if_err_ret("generation!clSetKernelArg(15) failed");
+
+    err = enqueue_after(de, de->kernels.generation, num_members(de, params), NULL, last);
+    _if_err_ret("generation!clEnqueueNDRangeKernel() failed");
+
+    if (DIFFEVO_ADAPT_SHADE == params->adapt_params.mode
+        && 0 != enqueue_adapt(de, params, last)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Checks that the whole population fits into a single work group for the persistent kernel.
+int check_persistent(diffevo_t *de, const diffevo_params_t *params) {
+    cl_int err;
+
+    size_t max_work;
+    err = clGetKernelWorkGroupInfo(de->kernels.generations, de->device, CL_KERNEL_WORK_GROUP_SIZE,
+        sizeof(size_t), &max_work, NULL);
+    _if_err_ret("clGetKernelWorkGroupInfo() failed");
+
+    if (params->num_pop > max_work) {
+        report_error("num_pop exceeds the work group size supported by the persistent kernel");
+        return -1;
+    }
+
+    cl_ulong local_mem;
+    err = clGetDeviceInfo(de->device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &local_mem,
+        NULL);
+    _if_err_ret("clGetDeviceInfo() failed");
+
+    if ((cl_ulong) params->num_pop * (params->num_attr + 1) * real_size(params) > local_mem) {
+        report_error("Population exceeds the local memory available to the persistent kernel");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Enqueues num_gen generations, starting with generation gen, as a single generations() kernel,
+// which updates population 0 in place.
+int enqueue_persistent_generations(diffevo_t *de, const diffevo_params_t *params, unsigned gen,
+    unsigned num_gen, cl_event *last) {
+    cl_int err;
+
+    err = clSetKernelArg(de->kernels.generations, 0, sizeof(cl_mem), rng_buffer(de));
+    _if_err_ret("generations!clSetKernelArg(0) failed");
+    err = clSetKernelArg(de->kernels.generations, 1, sizeof(cl_mem), &de->buffers.pop[0]);
+    _if_err_ret("generations!clSetKernelArg(1) failed");
+    err = clSetKernelArg(de->kernels.generations, 2, sizeof(cl_mem), &de->buffers.costs[0]);
+    _if_err_ret("generations!clSetKernelArg(2) failed");
+    err = clSetKernelArg(de->kernels.generations, 3, sizeof(cl_uint), &params->num_pop);
+    _if_err_ret("generations!clSetKernelArg(3) failed");
+    err = clSetKernelArg(de->kernels.generations, 4, sizeof(cl_uint), &params->num_attr);
+    _if_err_ret("generations!clSetKernelArg(4) failed");
+    err = set_real_arg(de->kernels.generations, 5, params, params->shrink);
+    _if_err_ret("generations!clSetKernelArg(5) failed");
+    err = set_real_arg(de->kernels.generations, 6, params, params->crossover);
+    _if_err_ret("generations!clSetKernelArg(6) failed");
+    err = clSetKernelArg(de->kernels.generations, 7, sizeof(cl_mem), &de->buffers.eval_data);
+    _if_err_ret("generations!clSetKernelArg(7) failed");
+    err = clSetKernelArg(de->kernels.generations, 8, sizeof(cl_uint), &num_gen);
+    _if_err_ret("generations!clSetKernelArg(8) failed");
+    err = clSetKernelArg(de->kernels.generations, 9, sizeof(cl_uint), &gen);
+    _if_err_ret("generations!clSetKernelArg(9) failed");
+    err = clSetKernelArg(de->kernels.generations, 10, sizeof(cl_mem), &de->buffers.bounds);
+    _if_err_ret("generations!clSetKernelArg(10) failed");
+    err = clSetKernelArg(de->kernels.generations, 11, sizeof(cl_mem), &de->buffers.saved);
+    _if_err_ret("generations!clSetKernelArg(11) failed");
+    err = clSetKernelArg(de->kernels.generations, 12,
+        params->num_pop * params->num_attr * real_size(params), NULL);
+    _if_err_ret("generations!clSetKernelArg(12) failed");
+    err = clSetKernelArg(de->kernels.generations, 13, params->num_pop * real_size(params), NULL);
+    _if_err_ret("generations!clSetKernelArg(13) failed");
+
+    // A single work group containing the whole population (per problem).
+    const size_t loc_work = params->num_pop;
+
+    err = enqueue_after(de, de->kernels.generations, num_members(de, params), &loc_work, last);
+    _if_err_ret("generations!clEnqueueNDRangeKernel() failed");
+
+    return 0;
+}
+
+// Enqueues count generations, starting with generation first, in whatever mode the parameters ask
+// for. The generation index is needed to know which population buffer is the current one.
+int enqueue_generations(diffevo_t *de, const diffevo_params_t *params, unsigned first,
+    unsigned count, cl_event *last) {
+    if (0 != params->persistent) {
+        // Each launch runs up to persistent generations, the population stays in buffer 0.
+        for (unsigned i = 0; i < count; i += params->persistent) {
+            const unsigned num_gen = count - i < params->persistent ? count - i
+                : params->persistent;
+
+            if (0 != enqueue_persistent_generations(de, params, first + i + 1, num_gen, last)) {
+                return -1;
+            }
+        }
+
+        return 0;
+    }
+
+    for (unsigned i = first; i < first + count; i++) {
+        // Since we use three buffers for population and costs each for memory efficiency reasons
+        // but actually only deal with two populations per iteration (current and mutated), we
+        // will always swap two of them.
+        const unsigned p_cand = (i % 2 == 0) ? 0 : 2, p_res = 2 - p_cand;
+
+        // Generation i computes generation i + 1, the initial population being generation 0.
+        const int err = params->fused
+            ? enqueue_fused_generation(de, params, i + 1, p_cand, p_res, last)
+            : enqueue_generation(de, params, i + 1, p_cand, p_res, last);
+        if (0 != err) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// Index of the buffer holding the population after num_gen generations. As with p_cand and p_res,
+// depending on the number of generations the output buffer could be swapped. The persistent
+// kernel always works in place.
+unsigned current_buffer(const diffevo_params_t *params, unsigned num_gen) {
+    return (0 != params->persistent || num_gen % 2 == 0) ? 0 : 2;
+}
+
+// Reduces the costs of population p on the device and reads back their minimum and spread (the
+// difference between maximum and minimum). For a batch, the worst problem counts, i.e. the largest
+// minimum and the largest spread.
+int read_status(diffevo_t *de, const diffevo_params_t *params, unsigned p, double *min_cost,
+    double *spread, cl_event *last) {
+    cl_int err;
+
+    if (0 != enqueue_reduce(de, params, p, last)) {
+        return -1;
+    }
+
+    const double start = wall_time();
+
+    double *status = malloc(de->num_problems * 2 * sizeof(double));
+    if (NULL == status) {
+        report_error("Out of memory");
+        return -1;
+    }
+
+    // Only the maximum and minimum cost of every problem, see reduce().
+    const size_t origin[3] = { 0, 0, 0 };
+    const size_t real = real_size(params);
+    const size_t region[3] = { 2 * real, de->num_problems, 1 };
+
+    err = clEnqueueReadBufferRect(de->queue, de->buffers.status, CL_TRUE, origin, origin, region,
+        (3 + params->num_attr) * real, 0, 0, 0, status, 1, last, NULL);
+    if (CL_SUCCESS != err) {
+        free(status);
+        report_error_code("clEnqueueReadBufferRect() failed", err);
+        return -1;
+    }
+
+    reals_to_doubles(status, status, de->num_problems * 2, real);
+
+    *min_cost = -INFINITY;
+    *spread = -INFINITY;
+
+    for (unsigned i = 0; i < de->num_problems; i++) {
+        *min_cost = fmax(*min_cost, status[2 * i + 1]);
+        *spread = fmax(*spread, status[2 * i] - status[2 * i + 1]);
+    }
+
+    free(status);
+
+    profile_phase(de, DIFFEVO_PHASE_READBACK, start);
+
+    return 0;
+}
+
+double wall_time(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int check_params(const diffevo_params_t *params, const diffevo_problem_t *problems,
+    unsigned num_problems) {
+    if (NULL == params) {
+        report_error("Parameters not specified");
+        return -1;
+    }
+    if (NULL == problems || 0 == num_problems) {
+        report_error("No problems specified");
+        return -1;
+    }
+    if (DIFFEVO_BACKEND_OPENCL == params->backend && num_problems > 1
+        && (DIFFEVO_LAYOUT_AOS != params->layout || params->eval_params.zero_copy)) {
+        report_error("Batches support neither the structure of arrays layout nor zero_copy");
+        return -1;
+    }
+    if ((unsigned long long) num_problems * params->num_pop > UINT_MAX - POP_ALIGN) {
+        report_error("Too many members over all problems");
+        return -1;
+    }
+    if (0 == params->num_pop || 0 == params->num_attr) {
+        report_error("num_pop and num_attr must not be zero");
+        return -1;
+    }
+    for (unsigned p = 0; p < num_problems; p++) {
+        if (problems[p].num_init > params->num_pop
+            || (0 != problems[p].num_init && NULL == problems[p].init_pop)) {
+            report_error("The initial candidates must be given and at most num_pop");
+            return -1;
+        }
+    }
+    if (params->fused && (0 != params->eval_params.local_work_size
+        || 0 != params->eval_params.local_data_size)) {
+        report_error("local_work_size and local_data_size are not supported in fused mode");
+        return -1;
+    }
+    if (0 != params->persistent && !params->fused) {
+        report_error("The persistent kernel requires fused mode");
+        return -1;
+    }
+    if (DIFFEVO_BACKEND_OPENCL != params->backend && DIFFEVO_BACKEND_NATIVE != params->backend) {
+        report_error("Unknown backend");
+        return -1;
+    }
+    if (DIFFEVO_BACKEND_NATIVE == params->backend && NULL == params->cost_fn) {
+        report_error("The native backend requires a cost_fn");
+        return -1;
+    }
+    if (DIFFEVO_BACKEND_OPENCL == params->backend && NULL != params->cost_fn
+        && (params->fused || DIFFEVO_LAYOUT_AOS != params->layout)) {
+        report_error("Host evaluation supports neither fused mode nor the structure of arrays "
+            "layout");
+        return -1;
+    }
+    if (DIFFEVO_LAYOUT_AOS != params->layout && DIFFEVO_LAYOUT_SOA != params->layout) {
+        report_error("Unknown population layout");
+        return -1;
+    }
+    if (DIFFEVO_RNG_TINYMT != params->rng && DIFFEVO_RNG_PHILOX != params->rng) {
+        report_error("Unknown random number generator");
+        return -1;
+    }
+    if (DIFFEVO_PRECISION_DOUBLE != params->precision
+        && DIFFEVO_PRECISION_FLOAT != params->precision) {
+        report_error("Unknown precision");
+        return -1;
+    }
+    if (DIFFEVO_BACKEND_OPENCL == params->backend && NULL != params->cost_fn
+        && DIFFEVO_PRECISION_DOUBLE != params->precision) {
+        report_error("Host evaluation requires double precision");
+        return -1;
+    }
+    if ((NULL == params->constraint_params.lower) != (NULL == params->constraint_params.upper)) {
+        report_error("Bounds require both lower and upper");
+        return -1;
+    }
+    if (NULL != params->constraint_params.lower) {
+        for (unsigned a = 0; a < params->num_attr; a++) {
+            const double lo = params->constraint_params.lower[a];
+            const double hi = params->constraint_params.upper[a];
+            if (!isfinite(lo) || !isfinite(hi) || lo > hi) {
+                report_error("Bounds must be finite, with lower <= upper");
+                return -1;
+            }
+        }
+    }
+    if (params->constraint_params.repair > DIFFEVO_REPAIR_RESAMPLE) {
+        report_error("Unknown repair strategy");
+        return -1;
+    }
+    if (params->constraint_params.feasible
+        && (DIFFEVO_BACKEND_OPENCL != params->backend || NULL != params->cost_fn)) {
+        report_error("feasible() requires the OpenCL backend without cost_fn");
+        return -1;
+    }
+    if (params->strategy > DIFFEVO_STRATEGY_RAND_2) {
+        report_error("Unknown mutation strategy");
+        return -1;
+    }
+    if (params->num_pop < (DIFFEVO_STRATEGY_RAND_2 == params->strategy ? 6u : 4u)) {
+        // The donors have to differ from each other and from the member itself.
+        report_error("num_pop must be at least 4 (6 for DIFFEVO_STRATEGY_RAND_2)");
+        return -1;
+    }
+    if (params->adapt_params.mode > DIFFEVO_ADAPT_SHADE) {
+        report_error("Unknown adaptation");
+        return -1;
+    }
+    if (DIFFEVO_ADAPT_NONE != params->adapt_params.mode) {
+        if (0 != params->persistent || NULL != params->checkpoint_params.path) {
+            report_error("Adaptation supports neither the persistent kernel nor checkpoints");
+            return -1;
+        }
+        if (params->adapt_params.memory_size > params->num_pop) {
+            report_error("memory_size must be at most num_pop");
+            return -1;
+        }
+    }
+    if (0 != params->stop_params.criteria && 0 == params->stop_params.check_interval) {
+        report_error("Stopping criteria require a check_interval");
+        return -1;
+    }
+    if (NULL != params->checkpoint_params.path || 0 != params->progress_params.interval) {
+        if (DIFFEVO_BACKEND_OPENCL != params->backend || params->island_params.num_islands > 1) {
+            report_error("Checkpoints and progress reports require the OpenCL backend and are not "
+                "supported with islands");
+            return -1;
+        }
+        if (NULL != params->checkpoint_params.path && 0 == params->checkpoint_params.interval) {
+            report_error("Checkpoints require an interval");
+            return -1;
+        }
+    }
+    if (params->island_params.num_islands > 1) {
+        if (DIFFEVO_BACKEND_OPENCL != params->backend || NULL != params->cost_fn
+            || DIFFEVO_LAYOUT_AOS != params->layout || num_problems > 1) {
+            report_error("Islands require the OpenCL backend and the array of structures layout, "
+                "and support neither cost_fn nor batches");
+            return -1;
+        }
+        if (0 == params->island_params.interval) {
+            report_error("Islands require a migration interval");
+            return -1;
+        }
+        if (DIFFEVO_RING != params->island_params.topology
+            && DIFFEVO_RING_BIDIRECTIONAL != params->island_params.topology) {
+            report_error("Unknown migration topology");
+            return -1;
+        }
+        if (3ull * params->island_params.num_migrants > params->num_pop) {
+            report_error("num_migrants must be at most num_pop / 3");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// Seed of RNG i of a problem with a fixed seed, spread by the same hash the kernels use.
+unsigned member_seed(unsigned seed, unsigned i) {
+    unsigned x = seed ^ (i * 0x9e3779b9u);
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// A fresh non-zero seed for problems without a fixed seed. Unlike rand() (only 15 bits on some
+// platforms), every bit depends on the time and on a counter, so that calls within the same
+// second still differ.
+unsigned random_seed(void) {
+    static volatile LONG counter;
+
+    const double t = wall_time();
+    const unsigned sec = (unsigned) t;
+    const unsigned nsec = (unsigned) ((t - sec) * 1e9);
+
+    const unsigned seed = member_seed(member_seed(sec, nsec),
+        (unsigned) InterlockedIncrement(&counter));
+    return 0 != seed ? seed : 1;
+}
+
+void member_seeds(const diffevo_params_t *params, const diffevo_problem_t *problems,
+    unsigned num_problems, unsigned *seeds) {
+    for (unsigned p = 0; p < num_problems; p++) {
+        const unsigned seed = 0 != problems[p].seed ? problems[p].seed : random_seed();
+
+        for (unsigned i = 0; i < params->num_pop; i++) {
+            seeds[p * params->num_pop + i] = member_seed(seed, i);
+        }
+    }
+}
+
+int uses_best(const diffevo_params_t *params) {
+    return DIFFEVO_STRATEGY_BEST_1 == params->strategy
+        || DIFFEVO_STRATEGY_CURRENT_TO_BEST_1 == params->strategy;
+}
+
+// Default number of entries of the SHADE memory, see adapt_params.
+#define ADAPT_MEMORY 10
+
+unsigned memory_size(const diffevo_params_t *params) {
+    if (0 != params->adapt_params.memory_size) {
+        return params->adapt_params.memory_size;
+    }
+    return params->num_pop < ADAPT_MEMORY ? params->num_pop : ADAPT_MEMORY;
+}
+
+void stop_init(stop_state_t *st) {
+    st->start_time = wall_time();
+    st->stall_cost = INFINITY;
+    st->stall_gen = 0;
+}
+
+unsigned stop_check_costs(const diffevo_params_t *params, stop_state_t *st, unsigned num_gen,
+    double min_cost, double spread) {
+    const unsigned criteria = params->stop_params.criteria;
+
+    if (min_cost < st->stall_cost) {
+        st->stall_cost = min_cost;
+        st->stall_gen = num_gen;
+    }
+
+    if ((criteria & DIFFEVO_STOP_COST) && min_cost <= params->stop_params.cost_target) {
+        return DIFFEVO_STOP_COST;
+    }
+    if ((criteria & DIFFEVO_STOP_SPREAD) && spread <= params->stop_params.spread_tol) {
+        return DIFFEVO_STOP_SPREAD;
+    }
+    if ((criteria & DIFFEVO_STOP_STALL)
+        && num_gen - st->stall_gen >= params->stop_params.stall_gens) {
+        return DIFFEVO_STOP_STALL;
+    }
+
+    return 0;
+}
+
+unsigned stop_check_host(const diffevo_params_t *params, const stop_state_t *st,
+    unsigned long long num_evals) {
+    const unsigned criteria = params->stop_params.criteria;
+
+    if ((criteria & DIFFEVO_STOP_TIME)
+        && wall_time() - st->start_time >= params->stop_params.time_budget) {
+        return DIFFEVO_STOP_TIME;
+    }
+    if ((criteria & DIFFEVO_STOP_EVALS) && num_evals >= params->stop_params.max_evals) {
+        return DIFFEVO_STOP_EVALS;
+    }
+
+    return 0;
+}
+
+// Number of generations to run from num_gen on, at most count, so that the run stops at the next
+// multiple of interval (0 for never).
+unsigned until_multiple(unsigned num_gen, unsigned interval, unsigned count) {
+    if (0 == interval) {
+        return count;
+    }
+
+    const unsigned left = interval - num_gen % interval;
+    return left < count ? left : count;
+}
+
+int is_multiple(unsigned num_gen, unsigned interval) {
+    return 0 != interval && 0 == num_gen % interval;
+}
+
+// Identifies checkpoint files, followed by the version of their format.
+#define CHECKPOINT_MAGIC 0x50434544
+#define CHECKPOINT_VERSION 1
+
+// Number of unsigned values in the header of a checkpoint file: magic, version, number of
+// problems, num_pop, num_attr, layout, size of the reals, rng and generation.
+#define CHECKPOINT_HEADER_LEN 9
+
+// Size of the state of a TinyMT RNG on the device, see alloc_buffers().
+#define RNG_STATE_SIZE 0x10
+
+// Snapshot of a run that is read back without blocking the device, see checkpoint_params and
+// progress_params.
+typedef struct {
+    // Generation the pending snapshot was taken after, 0 if none is pending.
+    unsigned gen;
+
+    // Whether the pending snapshot is to be written as checkpoint and reported as progress.
+    int checkpoint, progress;
+
+    // Completion of the reads.
+    cl_event evt;
+
+    // Host copies of the seeds, RNG states, population and costs, as stored on the device. The
+    // costs have room for doubles, see reals_to_doubles().
+    unsigned *seeds;
+    void *rng, *pop;
+    double *costs;
+
+    // Progress log, NULL if not needed.
+    FILE *log;
+} snapshot_t;
+
+size_t pop_bytes(const diffevo_t *de, const diffevo_params_t *params) {
+    return (size_t) num_members_aligned(de, params) * params->num_attr * real_size(params);
+}
+
+int snapshot_init(diffevo_t *de, const diffevo_params_t *params, snapshot_t *snap) {
+    const size_t members = num_members(de, params);
+
+    if (NULL != params->checkpoint_params.path) {
+        snap->seeds = malloc(members * sizeof(unsigned));
+        snap->rng = malloc(members * RNG_STATE_SIZE);
+        snap->pop = malloc(pop_bytes(de, params));
+    }
+    if (NULL != params->checkpoint_params.path || 0 != params->progress_params.interval) {
+        snap->costs = malloc(members * sizeof(double));
+    }
+
+    if ((NULL != params->checkpoint_params.path
+        && (NULL == snap->seeds || NULL == snap->rng || NULL == snap->pop))
+        || (0 != params->progress_params.interval && NULL == snap->costs)) {
+        report_error("Out of memory");
+        return -1;
+    }
+
+    if (0 != params->progress_params.interval && NULL != params->progress_params.log_path) {
+        snap->log = fopen(params->progress_params.log_path, "a");
+        if (NULL == snap->log) {
+            report_error("Failed to open the progress log");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void snapshot_release(snapshot_t *snap) {
+    if (NULL != snap->evt) {
+        clReleaseEvent(snap->evt);
+    }
+    if (NULL != snap->log) {
+        fclose(snap->log);
+    }
+
+    free(snap->seeds);
+    free(snap->rng);
+    free(snap->pop);
+    free(snap->costs);
+    memset(snap, 0, sizeof(snapshot_t));
+}
+
+// Enqueues the reads of the snapshot after generation num_gen, without waiting for them.
+int snapshot_begin(diffevo_t *de, const diffevo_params_t *params, unsigned num_gen,
+    int checkpoint, int progress, snapshot_t *snap, cl_event *last) {
+    cl_int err;
+
+    const size_t members = num_members(de, params);
+    const size_t real = real_size(params);
+    const unsigned p = current_buffer(params, num_gen);
+    cl_event evt;
+
+    if (checkpoint) {
+        err = clEnqueueReadBuffer(de->queue, de->buffers.seeds, CL_FALSE, 0,
+            members * sizeof(unsigned), snap->seeds, 1, last, &evt);
+        _if_err_ret("clEnqueueReadBuffer() failed");
+        profile_event(de, DIFFEVO_KERNEL_TRANSFER, evt);
+        set_last(last, evt);
+
+        if (!de->philox) {
+            err = clEnqueueReadBuffer(de->queue, de->buffers.rng, CL_FALSE, 0,
+                members * RNG_STATE_SIZE, snap->rng, 1, last, &evt);
+            _if_err_ret("clEnqueueReadBuffer() failed");
+            profile_event(de, DIFFEVO_KERNEL_TRANSFER, evt);
+            set_last(last, evt);
+        }
+
+        err = clEnqueueReadBuffer(de->queue, de->buffers.pop[p], CL_FALSE, 0,
+            pop_bytes(de, params), snap->pop, 1, last, &evt);
+        _if_err_ret("clEnqueueReadBuffer() failed");
+        profile_event(de, DIFFEVO_KERNEL_TRANSFER, evt);
+        set_last(last, evt);
+    }
+
+    err = clEnqueueReadBuffer(de->queue, de->buffers.costs[p], CL_FALSE, 0, members * real,
+        snap->costs, 1, last, &evt);
+    _if_err_ret("clEnqueueReadBuffer() failed");
+    profile_event(de, DIFFEVO_KERNEL_TRANSFER, evt);
+    set_last(last, evt);
+
+    // The reads complete in order, so the last one stands for all of them.
+    clRetainEvent(evt);
+    snap->evt = evt;
+    snap->gen = num_gen;
+    snap->checkpoint = checkpoint;
+    snap->progress = progress;
+
+    return 0;
+}
+
+// Writes the checkpoint file, first to a temporary file that then replaces the previous one, so
+// that a crash while writing never destroys the last checkpoint.
+int write_checkpoint(diffevo_t *de, const diffevo_params_t *params, const snapshot_t *snap) {
+    const char *path = params->checkpoint_params.path;
+    const size_t members = num_members(de, params);
+
+    char tmp_path[FILENAME_MAX];
+    const int len = snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    if (len < 0 || (size_t) len >= sizeof(tmp_path)) {
+        report_error("Checkpoint path too long");
+        return -1;
+    }
+
+    const unsigned header[CHECKPOINT_HEADER_LEN] = {
+        CHECKPOINT_MAGIC, CHECKPOINT_VERSION, de->num_problems, params->num_pop,
+        params->num_attr, params->layout, (unsigned) real_size(params), params->rng, snap->gen
+    };
+
+    FILE *fp = fopen(tmp_path, "wb");
+    if (NULL == fp) {
+        report_error("Failed to open the checkpoint file");
+        return -1;
+    }
+
+    int ok = CHECKPOINT_HEADER_LEN == fwrite(header, sizeof(unsigned), CHECKPOINT_HEADER_LEN, fp)
+        && members == fwrite(snap->seeds, sizeof(unsigned), members, fp)
+        && (de->philox || members == fwrite(snap->rng, RNG_STATE_SIZE, members, fp))
+        && 1 == fwrite(snap->pop, pop_bytes(de, params), 1, fp)
+        && 1 == fwrite(snap->costs, members * real_size(params), 1, fp);
+
+    ok = 0 == fclose(fp) && ok;
+
+    if (!ok || !MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING)) {
+        remove(tmp_path);
+        report_error("Failed to write the checkpoint file");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Waits for the pending snapshot (if any), then writes it as checkpoint and/or reports it as
+// progress.
+int snapshot_finish(diffevo_t *de, const diffevo_params_t *params, snapshot_t *snap) {
+    cl_int err;
+
+    if (0 == snap->gen) {
+        return 0;
+    }
+
+    const double start = wall_time();
+
+    err = clWaitForEvents(1, &snap->evt);
+    clReleaseEvent(snap->evt);
+    snap->evt = NULL;
+    _if_err_ret("clWaitForEvents() failed");
+
+    const unsigned gen = snap->gen;
+    snap->gen = 0;
+
+    if (snap->checkpoint && 0 != write_checkpoint(de, params, snap)) {
+        return -1;
+    }
+
+    if (snap->progress) {
+        const unsigned num_pop = params->num_pop;
+        const size_t members = num_members(de, params);
+
+        reals_to_doubles(snap->costs, snap->costs, members, real_size(params));
+
+        // Like the stopping criteria, the best cost of a batch is the one of its worst problem.
+        double best = -INFINITY;
+        double sum = 0.0;
+
+        for (unsigned p = 0; p < de->num_problems; p++) {
+            double min_cost = INFINITY;
+            for (unsigned n = 0; n < num_pop; n++) {
+                min_cost = fmin(min_cost, snap->costs[p * num_pop + n]);
+                sum += snap->costs[p * num_pop + n];
+            }
+            best = fmax(best, min_cost);
+        }
+
+        const double mean = sum / members;
+
+        if (NULL != snap->log) {
+            fprintf(snap->log, "%u %.17g %.17g\n", gen, best, mean);
+            fflush(snap->log);
+        }
+        if (NULL != params->progress_params.callback) {
+            params->progress_params.callback(gen, best, mean, params->progress_params.user_data);
+        }
+    }
+
+    profile_phase(de, DIFFEVO_PHASE_READBACK, start);
+
+    return 0;
+}
+
+// Restores the state of a run from the checkpoint file, see checkpoint_params. Returns 1 if it
+// was restored, 0 if there is no checkpoint file, and -1 on error.
+int load_checkpoint(diffevo_t *de, const diffevo_params_t *params, unsigned *num_gen) {
+    cl_int err = CL_SUCCESS;
+    int res = -1;
+
+    FILE *fp = fopen(params->checkpoint_params.path, "rb");
+    if (NULL == fp) {
+        return 0;
+    }
+
+    const size_t members = num_members(de, params);
+    const size_t real = real_size(params);
+
+    unsigned header[CHECKPOINT_HEADER_LEN];
+    unsigned *seeds = malloc(members * sizeof(unsigned));
+    void *rng = malloc(members * RNG_STATE_SIZE);
+    void *pop = malloc(pop_bytes(de, params));
+    void *costs = malloc(members * real);
+
+    if (NULL == seeds || NULL == rng || NULL == pop || NULL == costs) {
+        report_error("Out of memory");
+        goto __CleanUp;
+    }
+
+    if (CHECKPOINT_HEADER_LEN != fread(header, sizeof(unsigned), CHECKPOINT_HEADER_LEN, fp)
+        || CHECKPOINT_MAGIC != header[0] || CHECKPOINT_VERSION != header[1]) {
+        report_error("Not a checkpoint file");
+        goto __CleanUp;
+    }
+
+    if (de->num_problems != header[2] || params->num_pop != header[3]
+        || params->num_attr != header[4] || params->layout != header[5] || real != header[6]
+        || params->rng != header[7]) {
+        report_error("The checkpoint stems from different parameters");
+        goto __CleanUp;
+    }
+
+    if (members != fread(seeds, sizeof(unsigned), members, fp)
+        || (!de->philox && members != fread(rng, RNG_STATE_SIZE, members, fp))
+        || 1 != fread(pop, pop_bytes(de, params), 1, fp)
+        || 1 != fread(costs, members * real, 1, fp)) {
+        report_error("The checkpoint file is truncated");
+        goto __CleanUp;
+    }
+
+    *num_gen = header[8];
+    const unsigned p = current_buffer(params, *num_gen);
+
+    err = clEnqueueWriteBuffer(de->queue, de->buffers.seeds, CL_TRUE, 0,
+        members * sizeof(unsigned), seeds, 0, NULL, NULL);
+    _if_err_die("clEnqueueWriteBuffer() failed");
+
+    if (!de->philox) {
+        err = clEnqueueWriteBuffer(de->queue, de->buffers.rng, CL_TRUE, 0,
+            members * RNG_STATE_SIZE, rng, 0, NULL, NULL);
+        _if_err_die("clEnqueueWriteBuffer() failed");
+    }
+
+    err = clEnqueueWriteBuffer(de->queue, de->buffers.pop[p], CL_TRUE, 0, pop_bytes(de, params),
+        pop, 0, NULL, NULL);
+    _if_err_die("clEnqueueWriteBuffer() failed");
+    err = clEnqueueWriteBuffer(de->queue, de->buffers.costs[p], CL_TRUE, 0, members * real, costs,
+        0, NULL, NULL);
+    _if_err_die("clEnqueueWriteBuffer() failed");
+
+    res = 1;
+
+__CleanUp:
+    fclose(fp);
+    free(seeds);
+    free(rng);
+    free(pop);
+    free(costs);
+
+    return res;
+}
+
+// Uploads the given initial members of all problems, see init(). The rows of the other members
+// are left as they are.
+int upload_warm(diffevo_t *de, const diffevo_params_t *params) {
+    cl_int err = CL_SUCCESS;
+
+    const unsigned num_attr = params->num_attr;
+    const size_t real = real_size(params);
+
+    for (unsigned p = 0; p < de->num_problems && CL_SUCCESS == err; p++) {
+        const diffevo_problem_t *problem = &de->problems[p];
+        if (0 == problem->num_init) {
+            continue;
+        }
+
+        const size_t n = (size_t) problem->num_init * num_attr;
+
+        double *rows = malloc(n * sizeof(double));
+        if (NULL == rows) {
+            report_error("Out of memory");
+            return -1;
+        }
+
+        doubles_to_reals(rows, problem->init_pop, n, real);
+
+        err = clEnqueueWriteBuffer(de->queue, de->buffers.warm, CL_TRUE,
+            (size_t) p * params->num_pop * num_attr * real, n * real, rows, 0, NULL, NULL);
+        free(rows);
+    }
+    _if_err_ret("clEnqueueWriteBuffer() failed");
+
+    return 0;
+}
+
+// Uploads the known costs of the given initial members, if given. Their evaluation was skipped,
+// except for an eval() kernel with a local_work_size, whose costs are overwritten.
+int upload_warm_costs(diffevo_t *de, const diffevo_params_t *params, cl_event *last) {
+    cl_int err = CL_SUCCESS;
+
+    const size_t real = real_size(params);
+
+    for (unsigned p = 0; p < de->num_problems && CL_SUCCESS == err; p++) {
+        const diffevo_problem_t *problem = &de->problems[p];
+        if (0 == problem->num_init || NULL == problem->init_costs) {
+            continue;
+        }
+
+        double *costs = malloc(problem->num_init * sizeof(double));
+        if (NULL == costs) {
+            report_error("Out of memory");
+            return -1;
+        }
+
+        doubles_to_reals(costs, problem->init_costs, problem->num_init, real);
+
+        // Blocking, as the costs are freed right away.
+        cl_event evt;
+        err = clEnqueueWriteBuffer(de->queue, de->buffers.costs[0], CL_TRUE,
+            (size_t) p * params->num_pop * real, problem->num_init * real, costs,
+            NULL != *last ? 1 : 0, NULL != *last ? last : NULL, &evt);
+        free(costs);
+
+        if (CL_SUCCESS == err) {
+            profile_event(de, DIFFEVO_KERNEL_TRANSFER, evt);
+            set_last(last, evt);
+        }
+    }
+    _if_err_ret("clEnqueueWriteBuffer() failed");
+
+    return 0;
+}
+
+// Prepares the program and buffers for a run of the given problems, and enqueues the
+// initialization and evaluation of the initial population, unless the run resumes from a
+// checkpoint. num_gen receives the generation the run starts at.
+int run_begin(diffevo_t *de, const diffevo_params_t *params, const diffevo_problem_t *problems,
+    unsigned num_problems, unsigned *num_gen, cl_event *last) {
+    cl_int err;
+
+    de->num_problems = num_problems;
+    de->problems = problems;
+
+    memset(&de->stats, 0, sizeof(de->stats));
+
+    double start = wall_time();
+
+    if (0 != prepare_program(de, params)) {
+        return -1;
+    }
+
+    profile_phase(de, DIFFEVO_PHASE_BUILD, start);
+    start = wall_time();
+
+    if (0 != alloc_buffers(de, params, problems)) {
+        return -1;
+    }
+
+    //
+    // Generate the seeds that will be used in the init() kernel to initialize the RNGs, and
+    // gather the initial distribution of every problem.
+    //
+
+    const size_t members = num_members(de, params);
+
+    unsigned *seeds = malloc(members * sizeof(unsigned));
+    double *dist = malloc(num_problems * 2 * sizeof(double));
+    if (NULL == seeds || NULL == dist) {
+        free(seeds);
+        free(dist);
+        report_error("Out of memory");
+        return -1;
+    }
+
+    member_seeds(params, problems, num_problems, seeds);
+
+    for (unsigned p = 0; p < num_problems; p++) {
+        dist[2 * p] = problems[p].mu;
+        dist[2 * p + 1] = problems[p].sigma;
+    }
+
+    doubles_to_reals(dist, dist, num_problems * 2, real_size(params));
+
+    err = clEnqueueWriteBuffer(de->queue, de->buffers.seeds, CL_TRUE, 0,
+        members * sizeof(unsigned), seeds, 0, NULL, NULL);
+    if (CL_SUCCESS == err) {
+        err = clEnqueueWriteBuffer(de->queue, de->buffers.dist, CL_TRUE, 0,
+            num_problems * 2 * real_size(params), dist, 0, NULL, NULL);
+    }
+    if (CL_SUCCESS == err) {
+        // Reuse the seeds as the number of given initial members per problem.
+        for (unsigned p = 0; p < num_problems; p++) {
+            seeds[p] = problems[p].num_init;
+        }
+        err = clEnqueueWriteBuffer(de->queue, de->buffers.num_warm, CL_TRUE, 0,
+            num_problems * sizeof(cl_uint), seeds, 0, NULL, NULL);
+    }
+    free(seeds);
+    seeds = NULL;
+    free(dist);
+    dist = NULL;
+    _if_err_ret("clEnqueueWriteBuffer() failed");
+
+    if (NULL != de->buffers.warm && 0 != upload_warm(de, params)) {
+        return -1;
+    }
+
+    if (NULL != params->constraint_params.lower) {
+        double *bounds = malloc(2 * params->num_attr * sizeof(double));
+        if (NULL == bounds) {
+            report_error("Out of memory");
+            return -1;
+        }
+
+        memcpy(bounds, params->constraint_params.lower, params->num_attr * sizeof(double));
+        memcpy(bounds + params->num_attr, params->constraint_params.upper,
+            params->num_attr * sizeof(double));
+        doubles_to_reals(bounds, bounds, 2 * params->num_attr, real_size(params));
+
+        err = clEnqueueWriteBuffer(de->queue, de->buffers.bounds, CL_TRUE, 0,
+            2 * params->num_attr * real_size(params), bounds, 0, NULL, NULL);
+        free(bounds);
+        _if_err_ret("clEnqueueWriteBuffer() failed");
+    }
+
+    if (params->fused) {
+        const cl_uint zero = 0;
+        err = clEnqueueWriteBuffer(de->queue, de->buffers.saved, CL_TRUE, 0, sizeof(cl_uint),
+            &zero, 0, NULL, NULL);
+        _if_err_ret("clEnqueueWriteBuffer() failed");
+    }
+
+    if (DIFFEVO_ADAPT_NONE != params->adapt_params.mode) {
+        // Every member (jDE) or memory entry (SHADE) starts with shrink and crossover.
+        double pair[2] = { params->shrink, params->crossover };
+        doubles_to_reals(pair, pair, 2, real_size(params));
+
+        const size_t count = DIFFEVO_ADAPT_JDE == params->adapt_params.mode ? members
+            : (size_t) num_problems * memory_size(params);
+
+        err = clEnqueueFillBuffer(de->queue, de->buffers.ctrl, pair, 2 * real_size(params), 0,
+            count * 2 * real_size(params), 0, NULL, NULL);
+        _if_err_ret("clEnqueueFillBuffer() failed");
+
+        // SHADE updates the first entry of the memory next.
+        if (DIFFEVO_ADAPT_SHADE == params->adapt_params.mode) {
+            const double zero = 0;
+            err = clEnqueueFillBuffer(de->queue, de->buffers.ctrl, &zero, real_size(params),
+                count * 2 * real_size(params), num_problems * real_size(params), 0, NULL, NULL);
+            _if_err_ret("clEnqueueFillBuffer() failed");
+        }
+    }
+
+    *num_gen = 0;
+
+    int resumed = 0;
+    if (NULL != params->checkpoint_params.path && params->checkpoint_params.resume) {
+        resumed = load_checkpoint(de, params, num_gen);
+        if (0 > resumed) {
+            return -1;
+        }
+    }
+
+    profile_phase(de, DIFFEVO_PHASE_SETUP, start);
+
+    //
+    // Initialize the RNGs and population, and evaluate the initial population.
+    //
+
+    if (!resumed && 0 != enqueue_init(de, params, last)) {
+        return -1;
+    }
+
+    if (!resumed && 0 != (params->fused ? enqueue_fused_eval(de, params, 0, last)
+        : enqueue_eval(de, params, 0, last))) {
+        return -1;
+    }
+
+    if (!resumed && NULL != de->buffers.warm && 0 != upload_warm_costs(de, params, last)) {
+        return -1;
+    }
+
+    // fused_eval() already takes care of the infeasible members it evaluates, but not of the
+    // given ones with known costs.
+    if (!resumed && de->feasible && (!params->fused || 0 != num_known_costs(problems, num_problems))
+        && 0 != enqueue_check_feasible(de, params, 0, last)) {
+        return -1;
+    }
+
+    if (0 != params->persistent && 0 != check_persistent(de, params)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Determines the best population member (i.e. the one with least cost) of every problem after
+// num_gen generations on the device, unless the last convergence check (at status_gen) already
+// did, and reads back only their costs and attributes.
+int run_result(diffevo_t *de, const diffevo_params_t *params, unsigned num_gen,
+    unsigned status_gen, double *best, double *cost, cl_event *last) {
+    cl_int err;
+
+    if (status_gen != num_gen) {
+        if (0 != enqueue_reduce(de, params, current_buffer(params, num_gen), last)) {
+            return -1;
+        }
+    }
+
+    const size_t status_len = 3 + params->num_attr;
+    const double start = wall_time();
+
+    double *result = malloc(de->num_problems * status_len * sizeof(double));
+    if (NULL == result) {
+        report_error("Out of memory");
+        return -1;
+    }
+
+    err = clEnqueueReadBuffer(de->queue, de->buffers.status, CL_TRUE, 0,
+        de->num_problems * status_len * real_size(params), result, 1, last, NULL);
+
+    if (CL_SUCCESS != err) {
+        free(result);
+        report_error_code("clEnqueueReadBuffer() failed", err);
+        return -1;
+    }
+
+    reals_to_doubles(result, result, de->num_problems * status_len, real_size(params));
+
+    // Skips the maximum cost and the index, see reduce().
+    for (unsigned p = 0; p < de->num_problems; p++) {
+        cost[p] = result[p * status_len + 1];
+        memcpy(best + p * params->num_attr, result + p * status_len + 3,
+            params->num_attr * sizeof(double));
+    }
+
+    free(result);
+
+    // The fused kernels count the trials they skipped on the device, the host evaluation already
+    // did on the host.
+    if (params->fused) {
+        cl_uint saved;
+        err = clEnqueueReadBuffer(de->queue, de->buffers.saved, CL_TRUE, 0, sizeof(cl_uint),
+            &saved, 0, NULL, NULL);
+        _if_err_ret("clEnqueueReadBuffer() failed");
+
+        de->stats.num_evals_saved += saved;
+    }
+
+    profile_phase(de, DIFFEVO_PHASE_READBACK, start);
+
+    return 0;
+}
+
+// Picks the k best (or worst) members that are not yet taken, and marks them as taken.
+void pick_members(const double *costs, unsigned num_pop, unsigned k, int worst,
+    unsigned char *taken, unsigned *picked) {
+    for (unsigned j = 0; j < k; j++) {
+        unsigned m = UINT_MAX;
+
+        for (unsigned n = 0; n < num_pop; n++) {
+            if (!taken[n] && (UINT_MAX == m
+                || (worst ? costs[n] > costs[m] : costs[n] < costs[m]))) {
+                m = n;
+            }
+        }
+
+        taken[m] = 1;
+        picked[j] = m;
+    }
+}
+
+// Host memory of the migrations of a run. The writes of a migration are not waited for, so they
+// read from here while the next chunk runs, until the run waits for all islands at its end.
+typedef struct {
+    double *costs;
+    unsigned char *taken;
+    unsigned *best;
+    unsigned *worst;
+    char *migrants;
+    char *migrant_costs;
+} migration_t;
+
+int migration_alloc(const diffevo_t *de, const diffevo_params_t *params, migration_t *mig) {
+    const unsigned num_islands = de->num_islands;
+    const unsigned num_pop = params->num_pop;
+    const unsigned k = params->island_params.num_migrants;
+    const size_t real = real_size(params);
+
+    mig->costs = malloc((size_t) num_islands * num_pop * sizeof(double));
+    mig->taken = malloc(num_pop);
+    mig->best = malloc((size_t) num_islands * k * sizeof(unsigned));
+    mig->worst = malloc((size_t) num_islands * 2 * k * sizeof(unsigned));
+    mig->migrants = malloc((size_t) num_islands * k * params->num_attr * real);
+    mig->migrant_costs = malloc((size_t) num_islands * 2 * k * real);
+
+    if (NULL == mig->costs || NULL == mig->taken || NULL == mig->best || NULL == mig->worst
+        || NULL == mig->migrants || NULL == mig->migrant_costs) {
+        report_error("Out of memory");
+        return -1;
+    }
+
+    return 0;
+}
+
+void migration_free(migration_t *mig) {
+    free(mig->costs);
+    free(mig->taken);
+    free(mig->best);
+    free(mig->worst);
+    free(mig->migrants);
+    free(mig->migrant_costs);
+    memset(mig, 0, sizeof(migration_t));
+}
+
+// Reads back the costs of all islands after generation num_gen. The reads of all islands are
+// enqueued before waiting for any of them, so the islands finish their chunks in parallel.
+int read_island_costs(diffevo_t *de, const diffevo_params_t *params, unsigned num_gen,
+    cl_event *lasts, migration_t *mig, double *min_cost, double *spread) {
+    cl_int err;
+
+    const unsigned num_islands = de->num_islands;
+    const unsigned num_pop = params->num_pop;
+    const unsigned p = current_buffer(params, num_gen);
+    const size_t real = real_size(params);
+    cl_event evt;
+
+    for (unsigned i = 0; i < num_islands; i++) {
+        diffevo_t *island = de->islands[i];
+
+        err = clEnqueueReadBuffer(island->queue, island->buffers.costs[p], CL_FALSE, 0,
+            num_pop * real, mig->costs + (size_t) i * num_pop, NULL != lasts[i] ? 1 : 0,
+            NULL != lasts[i] ? &lasts[i] : NULL, &evt);
+        _if_err_ret("clEnqueueReadBuffer() failed");
+        profile_event(island, DIFFEVO_KERNEL_TRANSFER, evt);
+        set_last(&lasts[i], evt);
+        clFlush(island->queue);
+    }
+
+    *min_cost = INFINITY;
+    double max_cost = -INFINITY;
+
+    // Events of different contexts cannot be waited for at once.
+    for (unsigned i = 0; i < num_islands; i++) {
+        const double start = wall_time();
+        err = clWaitForEvents(1, &lasts[i]);
+        _if_err_ret("clWaitForEvents() failed");
+        profile_phase(de->islands[i], DIFFEVO_PHASE_READBACK, start);
+
+        double *c = mig->costs + (size_t) i * num_pop;
+        reals_to_doubles(c, c, num_pop, real);
+
+        for (unsigned n = 0; n < num_pop; n++) {
+            *min_cost = fmin(*min_cost, c[n]);
+            max_cost = fmax(max_cost, c[n]);
+        }
+    }
+
+    *spread = max_cost - *min_cost;
+
+    return 0;
+}
+
+// Exchanges the best num_migrants members between the islands after num_gen generations, based on
+// the costs of the preceding read_island_costs(). Every island sends its best members to the next
+// island (and to the previous one for DIFFEVO_RING_BIDIRECTIONAL), where they replace the worst
+// members. The overwrites are chained into lasts without waiting for them.
+int migrate(diffevo_t *de, const diffevo_params_t *params, unsigned num_gen, cl_event *lasts,
+    migration_t *mig) {
+    cl_int err;
+
+    const unsigned num_islands = de->num_islands;
+    const unsigned num_pop = params->num_pop;
+    const unsigned k = params->island_params.num_migrants;
+    const unsigned p = current_buffer(params, num_gen);
+    const size_t real = real_size(params);
+    const size_t row = params->num_attr * real;
+    cl_event evt;
+
+    // With two islands, the previous island is the next one as well.
+    const unsigned num_sources = DIFFEVO_RING_BIDIRECTIONAL == params->island_params.topology
+        && num_islands > 2 ? 2 : 1;
+
+    //
+    // Pick the emigrants and the members they replace, and read back the emigrants of all islands.
+    //
+
+    for (unsigned i = 0; i < num_islands; i++) {
+        diffevo_t *island = de->islands[i];
+        const double *c = mig->costs + (size_t) i * num_pop;
+
+        // The best members are never replaced themselves.
+        memset(mig->taken, 0, num_pop);
+        pick_members(c, num_pop, k, 0, mig->taken, mig->best + (size_t) i * k);
+        pick_members(c, num_pop, num_sources * k, 1, mig->taken,
+            mig->worst + (size_t) i * num_sources * k);
+
+        for (unsigned j = 0; j < k; j++) {
+            err = clEnqueueReadBuffer(island->queue, island->buffers.pop[p], CL_FALSE,
+                mig->best[i * k + j] * row, row, mig->migrants + ((size_t) i * k + j) * row,
+                1, &lasts[i], &evt);
+            _if_err_ret("clEnqueueReadBuffer() failed");
+            profile_event(island, DIFFEVO_KERNEL_TRANSFER, evt);
+            set_last(&lasts[i], evt);
+        }
+        clFlush(island->queue);
+    }
+
+    for (unsigned i = 0; i < num_islands; i++) {
+        const double start = wall_time();
+        err = clWaitForEvents(1, &lasts[i]);
+        _if_err_ret("clWaitForEvents() failed");
+        profile_phase(de->islands[i], DIFFEVO_PHASE_READBACK, start);
+    }
+
+    //
+    // Overwrite the worst members of every island with the migrants of its neighbor(s).
+    //
+
+    for (unsigned i = 0; i < num_islands; i++) {
+        diffevo_t *island = de->islands[i];
+
+        for (unsigned s = 0; s < num_sources; s++) {
+            const unsigned src = 0 == s ? (i + num_islands - 1) % num_islands
+                : (i + 1) % num_islands;
+
+            for (unsigned j = 0; j < k; j++) {
+                const size_t w = ((size_t) i * num_sources + s) * k + j;
+                const unsigned m = mig->worst[w];
+                char *c = mig->migrant_costs + w * real;
+                doubles_to_reals(c, &mig->costs[(size_t) src * num_pop + mig->best[src * k + j]],
+                    1, real);
+
+                err = clEnqueueWriteBuffer(island->queue, island->buffers.pop[p], CL_FALSE,
+                    m * row, row, mig->migrants + ((size_t) src * k + j) * row, 1, &lasts[i],
+                    &evt);
+                _if_err_ret("clEnqueueWriteBuffer() failed");
+                profile_event(island, DIFFEVO_KERNEL_TRANSFER, evt);
+                set_last(&lasts[i], evt);
+
+                err = clEnqueueWriteBuffer(island->queue, island->buffers.costs[p], CL_FALSE,
+                    m * real, real, c, 1, &lasts[i], &evt);
+                _if_err_ret("clEnqueueWriteBuffer() failed");
+                profile_event(island, DIFFEVO_KERNEL_TRANSFER, evt);
+                set_last(&lasts[i], evt);
+            }
+        }
     }
 
     return 0;
 }
 
-#define _if_err_die(msg) if(CL_SUCCESS != err) { report_error_code(msg, err); goto __CleanUp; }
+// Runs the island model, see island_params. The islands run their generations concurrently, the
+// host only synchronizes with them for the migrations.
+int run_islands(diffevo_t *de, const diffevo_params_t *params, const diffevo_problem_t *problem,
+    double *best, double *cost) {
+    int err = 0;
 
-int diffevo_solve(const char *path, const diffevo_params_t *params, double *best, double *cost) {
-    int err;
+    const unsigned num_islands = de->num_islands;
+    const unsigned interval = params->island_params.interval;
 
-    if (NULL == path) {
-        report_error("eval() path not specified");
-        return -1;
-    }
+    memset(&de->stats, 0, sizeof(de->stats));
 
-    err = init_cl();
-    if (0 != err) {
-        report_error("Error while creating OpenCL context");
+    cl_event *lasts = calloc(num_islands, sizeof(cl_event));
+    diffevo_problem_t *problems = malloc(num_islands * sizeof(diffevo_problem_t));
+    double *results = malloc((size_t) num_islands * (1 + params->num_attr) * sizeof(double));
+    migration_t mig = { 0 };
+
+    if (NULL == lasts || NULL == problems || NULL == results) {
+        report_error("Out of memory");
         goto __CleanUp;
     }
 
-    err = create_program(path);
+    err = migration_alloc(de, params, &mig);
     if (0 != err) {
-        report_error("Error while loading program");
         goto __CleanUp;
     }
 
+    // Every island starts from a different population, but a fixed seed still reproduces the
+    // whole run.
+    const unsigned seed = 0 != problem->seed ? problem->seed : random_seed();
+
+    for (unsigned i = 0; i < num_islands; i++) {
+        problems[i] = *problem;
+        problems[i].seed = member_seed(seed, i) | 1;
+
+        // Islands start from scratch, checkpoints are not supported.
+        unsigned first_gen;
+        err = run_begin(de->islands[i], params, &problems[i], 1, &first_gen, &lasts[i]);
+        if (0 != err) {
+            goto __CleanUp;
+        }
+        clFlush(de->islands[i]->queue);
+    }
+
     //
-    // Use one RNG per population member. A finer granularity does not make sense, because the
-    // overhead would be too high (since mutation and crossover is rather quick), and a coarser
-    // granularity would drastically decrease the parallelism (would not be per member anymore).
+    // Run the generations in chunks that end at every migration and every check of the stopping
+    // criteria. Both read back the costs of all islands, and the criteria are checked whenever
+    // they are available.
     //
 
-    buffers.rng = clCreateBuffer(context, CL_MEM_READ_WRITE, params->num_pop * 0x10, NULL, &err);
-    _if_err_die("clCreateBuffer() failed");
+    const unsigned criteria = params->stop_params.criteria;
+    const unsigned check = 0 != criteria ? params->stop_params.check_interval : 0;
 
-    //
-    // Generate the seeds that will be used in the init() kernel to initialize the RNGs.
-    // 
+    stop_state_t stop;
+    stop_init(&stop);
 
-    srand((unsigned) time(NULL));
+    unsigned num_gen = 0;
+    unsigned reason = 0;
 
-    unsigned *seeds = malloc(params->num_pop * sizeof(unsigned));
-    if (NULL == seeds) {
-        report_error("Out of memory");
-        goto __CleanUp;
-    }
+    const unsigned long long members = (unsigned long long) num_islands * params->num_pop;
+    const unsigned skipped = num_islands * num_skipped_init(de->islands[0], params);
+
+    while (num_gen < params->num_iter && 0 == reason) {
+        unsigned count = interval - num_gen % interval;
+        if (0 != check && check - num_gen % check < count) {
+            count = check - num_gen % check;
+        }
+        if (params->num_iter - num_gen < count) {
+            count = params->num_iter - num_gen;
+        }
+
+        for (unsigned i = 0; i < num_islands; i++) {
+            err = enqueue_generations(de->islands[i], params, num_gen, count, &lasts[i]);
+            if (0 != err) {
+                goto __CleanUp;
+            }
+            clFlush(de->islands[i]->queue);
+        }
+        num_gen += count;
+
+        if (num_gen == params->num_iter) {
+            break;
+        }
 
-    for (unsigned i = 0; i < params->num_pop; i++) {
-        seeds[i] = rand();
+        double min_cost, spread;
+        err = read_island_costs(de, params, num_gen, lasts, &mig, &min_cost, &spread);
+        if (0 != err) {
+            goto __CleanUp;
+        }
+
+        if (0 == num_gen % interval) {
+            err = migrate(de, params, num_gen, lasts, &mig);
+            if (0 != err) {
+                goto __CleanUp;
+            }
+        }
+
+        if (0 != criteria) {
+            reason = stop_check_costs(params, &stop, num_gen, min_cost, spread);
+            if (0 == reason) {
+                reason = stop_check_host(params, &stop, num_evals(members, skipped, 0, num_gen));
+            }
+        }
+        if (0 == reason && 0 != de->cancel) {
+            reason = DIFFEVO_STOP_CANCELLED;
+        }
     }
 
-    buffers.seeds = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-        params->num_pop * sizeof(unsigned), seeds, &err);
-    free(seeds);
-    seeds = NULL;
-    _if_err_die("clCreateBuffer() failed");
+    de->stats.num_gen = num_gen;
+    de->stats.num_evals = num_evals(members, skipped, 0, num_gen);
+    de->stats.stop_reason = reason;
 
     //
-    // Use three population and cost buffers, so that we can select() from two into one separate.
-    // Altough increasing the memory consumption, it allows to make the input buffers cacheable.
+    // The best member of all islands is the result.
     //
 
-    for (unsigned i = 0; i < 3; i++) {
-        buffers.pop[i] = clCreateBuffer(context, CL_MEM_READ_WRITE,
-            params->num_pop * params->num_attr * sizeof(double), NULL, &err);
-        _if_err_die("clCreateBuffer() failed");
-        buffers.costs[i] = clCreateBuffer(context, CL_MEM_READ_WRITE,
-            params->num_pop * sizeof(double), NULL, &err);
-        _if_err_die("clCreateBuffer() failed");
+    for (unsigned i = 0; i < num_islands; i++) {
+        double *r = results + (size_t) i * (1 + params->num_attr);
+
+        err = run_result(de->islands[i], params, num_gen, UINT_MAX, r + 1, r, &lasts[i]);
+        if (0 != err) {
+            goto __CleanUp;
+        }
+        de->stats.num_evals_saved += de->islands[i]->stats.num_evals_saved;
+
+        if (0 == i || r[0] < *cost) {
+            *cost = r[0];
+            memcpy(best, r + 1, params->num_attr * sizeof(double));
+        }
     }
 
-    //
-    // If the user wishes, we copy their data into a read-only buffer, so it can be used
-    // during eval(). This could be for example some dynamic parameters.
-    //
+__CleanUp:
+
+    for (unsigned i = 0; i < num_islands; i++) {
+        clFinish(de->islands[i]->queue);
+
+        if (NULL != lasts && NULL != lasts[i]) {
+            clReleaseEvent(lasts[i]);
+        }
+    }
 
-    if (NULL != params->eval_params.const_data_ptr) {
-        buffers.eval_data = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-            params->eval_params.const_data_size, params->eval_params.const_data_ptr, &err);
-        _if_err_die("clCreateBuffer() failed");
+    if (de->profiling) {
+        finish_profile(de, params, de->islands, num_islands);
     }
 
-    kernels.init = clCreateKernel(program, "init", &err);
-    _if_err_die("Failed to create init() kernel");
-    kernels.eval = clCreateKernel(program, "eval", &err);
-    _if_err_die("Failed to create eval() kernel");
-    kernels.mutate = clCreateKernel(program, "mutate", &err);
-    _if_err_die("Failed to create mutate() kernel");
-    kernels.select = clCreateKernel(program, "select", &err);
-    _if_err_die("Failed to create select() kernel");
+    // Only now that all queues are finished, the pending migrations no longer read from it.
+    migration_free(&mig);
 
-    const size_t pop_dim = params->num_pop;
+    free(lasts);
+    free(problems);
+    free(results);
 
-    //
-    // Initialize the RNGs and population.
-    //
+    return last_error;
+}
+
+int diffevo_run(diffevo_t *de, const diffevo_params_t *params, double *best, double *cost) {
+    if (NULL == params) {
+        report_error("Parameters not specified");
+        return -1;
+    }
+
+    const diffevo_problem_t problem = params_problem(params);
+
+    return diffevo_run_batch(de, params, &problem, 1, best, cost);
+}
 
-    err = clSetKernelArg(kernels.init, 0, sizeof(cl_mem), &buffers.rng);
-    _if_err_die("init!clSetKernelArg(0) failed");
-    err = clSetKernelArg(kernels.init, 1, sizeof(cl_mem), &buffers.seeds);
-    _if_err_die("init!clSetKernelArg(1) failed");
-    err = clSetKernelArg(kernels.init, 2, sizeof(cl_mem), &buffers.pop[0]);
-    _if_err_die("init!clSetKernelArg(2) failed");
-    err = clSetKernelArg(kernels.init, 3, sizeof(cl_uint), &params->num_pop);
-    _if_err_die("init!clSetKernelArg(3) failed");
-    err = clSetKernelArg(kernels.init, 4, sizeof(cl_uint), &params->num_attr);
-    _if_err_die("init!clSetKernelArg(4) failed");
-    err = clSetKernelArg(kernels.init, 5, sizeof(cl_double), &params->mu);
-    _if_err_die("init!clSetKernelArg(5) failed");
-    err = clSetKernelArg(kernels.init, 6, sizeof(cl_double), &params->sigma);
-    _if_err_die("init!clSetKernelArg(6) failed");
-
-    cl_event init_evt;
-    err = clEnqueueNDRangeKernel(queue, kernels.init, 1, NULL, &pop_dim, NULL,
-        0, NULL, &init_evt);
-    _if_err_die("init!clEnqueueNDRangeKernel() failed");
+// Number of generations between two checks whether an asynchronous run without stopping criteria
+// was cancelled.
+#define CANCEL_INTERVAL 50
+
+unsigned long long num_evals(size_t members, unsigned skipped, unsigned first_gen,
+    unsigned num_gen) {
+    const unsigned long long initial = 0 == first_gen ? members - skipped : 0;
+    return (unsigned long long) members * (num_gen - first_gen) + initial;
+}
+
+// Runs a batch on a handle that is marked busy, see diffevo_run_batch().
+int run_batch(diffevo_t *de, const diffevo_params_t *params, const diffevo_problem_t *problems,
+    unsigned num_problems, double *best, double *cost) {
+    int err;
+
+    last_error = 0;
+
+    if (0 != check_params(params, problems, num_problems)) {
+        return -1;
+    }
+
+    if (params->backend != de->backend) {
+        report_error("The backend does not match the one of the handle");
+        return -1;
+    }
+
+    if ((params->island_params.num_islands > 1 ? params->island_params.num_islands : 0)
+        != de->num_islands) {
+        report_error("The number of islands does not match the one of the handle");
+        return -1;
+    }
+
+    if (DIFFEVO_BACKEND_NATIVE == de->backend) {
+        return native_run(&de->native, params, problems, num_problems, best, cost, &de->stats,
+            &de->cancel);
+    }
+
+    if (0 != de->num_islands) {
+        return run_islands(de, params, problems, best, cost);
+    }
+
+    // Event of the most recently enqueued command, which the next one waits for, and the one of the
+    // previous chunk of an asynchronous run.
+    cl_event last = NULL;
+    cl_event pending = NULL;
+
+    snapshot_t snap = { 0 };
+
+    unsigned num_gen = 0;
+    err = run_begin(de, params, problems, num_problems, &num_gen, &last);
+    if (0 == err) {
+        err = snapshot_init(de, params, &snap);
+    }
+    if (0 != err) {
+        goto __CleanUp;
+    }
+
+    // A resumed run neither evaluates the initial population nor the generations before the
+    // checkpoint.
+    const unsigned first_gen = num_gen;
+    const unsigned skipped = num_skipped_init(de, params);
 
     //
-    // Evaluate the initial population.
+    // Run the generations. Without stopping criteria everything is enqueued at once, otherwise
+    // in chunks of check_interval generations, after each of which the criteria are checked. An
+    // asynchronous run always uses chunks, so that it can be cancelled in between. Chunks also
+    // end at every checkpoint and progress report.
     //
 
-    err = clSetKernelArg(kernels.eval, 0, sizeof(cl_mem), &buffers.pop[0]);
-    _if_err_die("eval!clSetKernelArg(0) failed");
-    err = clSetKernelArg(kernels.eval, 1, sizeof(cl_mem), &buffers.costs[0]);
-    _if_err_die("eval!clSetKernelArg(1) failed");
-    err = clSetKernelArg(kernels.eval, 2, sizeof(cl_uint), &params->num_pop);
-    _if_err_die("eval!clSetKernelArg(2) failed");
-    err = clSetKernelArg(kernels.eval, 3, sizeof(cl_uint), &params->num_attr);
-    _if_err_die("eval!clSetKernelArg(3) failed");
-    err = clSetKernelArg(kernels.eval, 4, sizeof(cl_mem), &buffers.eval_data);
-    _if_err_die("eval!clSetKernelArg(4) failed");
-    err = clSetKernelArg(kernels.eval, 5, params->eval_params.local_data_size, NULL);
-    _if_err_die("eval!clSetKernelArg(5) failed");
+    const size_t members = num_members(de, params);
 
-    size_t eval_glb_work, eval_loc_work;
-    size_t *eval_loc_work_ptr;
+    const unsigned criteria = params->stop_params.criteria;
+    const unsigned interval = 0 != params->stop_params.check_interval
+        ? params->stop_params.check_interval : CANCEL_INTERVAL;
+    const unsigned check = 0 != criteria || de->async ? interval : 0;
+    const unsigned checkpoint = NULL != params->checkpoint_params.path
+        ? params->checkpoint_params.interval : 0;
+    const unsigned progress = params->progress_params.interval;
 
-    if (0 < params->eval_params.local_work_size) {
-        // The user explicitly set the number of work groups that are used per population member.
-        // The global work is picked so that for every population member we have as much eval()
-        // calls (in parallel) as the user chose.
-        // TODO: Notify the user if the number of work group exceeds hardware limitations.
-        eval_loc_work = params->eval_params.local_work_size;
-        eval_loc_work_ptr = &eval_loc_work;
-        eval_glb_work = eval_loc_work * pop_dim;
-    } else {
-        // Passing NULL as local_work_size tells the compiler find the ideal number of work groups.
-        // Note, that the global work is reduced, because eval() is called only once per member.
-        eval_loc_work_ptr = NULL;
-        eval_glb_work = pop_dim;
+    // Stopping criteria that need the population costs, only then the reduction is worthwhile.
+    const unsigned cost_criteria = DIFFEVO_STOP_COST | DIFFEVO_STOP_SPREAD | DIFFEVO_STOP_STALL;
+
+    stop_state_t stop;
+    stop_init(&stop);
+
+    unsigned reason = 0;
+
+    // Generation the status buffer was last computed for, UINT_MAX if never.
+    unsigned status_gen = UINT_MAX;
+
+    while (num_gen < params->num_iter && 0 == reason) {
+        unsigned count = params->num_iter - num_gen;
+        count = until_multiple(num_gen, check, count);
+        count = until_multiple(num_gen, checkpoint, count);
+        count = until_multiple(num_gen, progress, count);
+
+        err = enqueue_generations(de, params, num_gen, count, &last);
+        if (0 != err) {
+            goto __CleanUp;
+        }
+        num_gen += count;
+
+        // The previous snapshot is written while the device already runs this chunk.
+        err = snapshot_finish(de, params, &snap);
+        if (0 != err) {
+            goto __CleanUp;
+        }
+
+        if (is_multiple(num_gen, checkpoint) || is_multiple(num_gen, progress)) {
+            err = snapshot_begin(de, params, num_gen, is_multiple(num_gen, checkpoint),
+                is_multiple(num_gen, progress), &snap, &last);
+            if (0 != err) {
+                goto __CleanUp;
+            }
+            clFlush(de->queue);
+        }
+
+        if (!is_multiple(num_gen, check) && num_gen != params->num_iter) {
+            continue;
+        }
+
+        if (0 != (criteria & cost_criteria)) {
+            double min_cost, spread;
+            err = read_status(de, params, current_buffer(params, num_gen), &min_cost, &spread,
+                &last);
+            if (0 != err) {
+                goto __CleanUp;
+            }
+            status_gen = num_gen;
+
+            reason = stop_check_costs(params, &stop, num_gen, min_cost, spread);
+        } else if (0 != criteria) {
+            // Only host-side criteria, so just wait for the chunk to finish.
+            clFinish(de->queue);
+        } else if (de->async) {
+            // Only wait for the previous chunk, so that the device never runs dry in between.
+            if (NULL != pending) {
+                err = clWaitForEvents(1, &pending);
+                clReleaseEvent(pending);
+                pending = NULL;
+                _if_err_die("clWaitForEvents() failed");
+            }
+            clRetainEvent(last);
+            pending = last;
+            clFlush(de->queue);
+        }
+
+        if (0 == reason) {
+            reason = stop_check_host(params, &stop,
+                num_evals(members, skipped, first_gen, num_gen));
+        }
+        if (0 == reason && 0 != de->cancel) {
+            reason = DIFFEVO_STOP_CANCELLED;
+        }
     }
 
-    cl_event eval_evt;
-    err = clEnqueueNDRangeKernel(queue, kernels.eval, 1, NULL, &eval_glb_work,
-        eval_loc_work_ptr, 1, &init_evt, &eval_evt);
-    _if_err_die("eval!clEnqueueNDRangeKernel() failed");
+    clFlush(de->queue);
 
-    cl_event select_evt = NULL;
+    err = snapshot_finish(de, params, &snap);
+    if (0 != err) {
+        goto __CleanUp;
+    }
 
-    for (unsigned i = 0; i < params->num_iter; i++) {
-        // Since we use three buffers for population and costs each for memory efficiency reasons
-        // but actually only deal with two populations per iteration (current and mutated), we will
-        // always swap two of them.
-        const unsigned p_cand = (i % 2 == 0) ? 0 : 2, p_res = 2 - p_cand;
+    clFinish(de->queue);
 
-        //
-        // Mutate the population.
-        //
+    de->stats.num_gen = num_gen;
+    de->stats.num_evals = num_evals(members, skipped, first_gen, num_gen);
+    de->stats.stop_reason = reason;
 
-        err = clSetKernelArg(kernels.mutate, 0, sizeof(cl_mem), &buffers.rng);
-        _if_err_die("mutate!clSetKernelArg(0) failed");
-        err = clSetKernelArg(kernels.mutate, 1, sizeof(cl_mem), &buffers.pop[p_cand]);
-        _if_err_die("mutate!clSetKernelArg(1) failed");
-        err = clSetKernelArg(kernels.mutate, 2, sizeof(cl_mem), &buffers.pop[1]);
-        _if_err_die("mutate!clSetKernelArg(2) failed");
-        err = clSetKernelArg(kernels.mutate, 3, sizeof(cl_uint), &params->num_pop);
-        _if_err_die("mutate!clSetKernelArg(3) failed");
-        err = clSetKernelArg(kernels.mutate, 4, sizeof(cl_uint), &params->num_attr);
-        _if_err_die("mutate!clSetKernelArg(4) failed");
-        err = clSetKernelArg(kernels.mutate, 5, sizeof(cl_double), &params->shrink);
-        _if_err_die("mutate!clSetKernelArg(5) failed");
-        err = clSetKernelArg(kernels.mutate, 6, sizeof(cl_double), &params->crossover);
-        _if_err_die("mutate!clSetKernelArg(6) failed");
-
-        cl_event mutate_evt;
-        err = clEnqueueNDRangeKernel(queue, kernels.mutate, 1, NULL, &pop_dim, NULL, 1,
-            (i == 0) ? &init_evt : &select_evt, &mutate_evt);
-        _if_err_die("mutate!clEnqueueNDRangeKernel() failed");
+    err = run_result(de, params, num_gen, status_gen, best, cost, &last);
 
-        //
-        // Evaluate the mutated population.
-        //
+__CleanUp:
 
-        err = clSetKernelArg(kernels.eval, 0, sizeof(cl_mem), &buffers.pop[1]);
-        _if_err_die("eval!clSetKernelArg(0) failed");
-        err = clSetKernelArg(kernels.eval, 1, sizeof(cl_mem), &buffers.costs[1]);
-        _if_err_die("eval!clSetKernelArg(1) failed");
-        err = clSetKernelArg(kernels.eval, 2, sizeof(cl_uint), &params->num_pop);
-        _if_err_die("eval!clSetKernelArg(2) failed");
-        err = clSetKernelArg(kernels.eval, 3, sizeof(cl_uint), &params->num_attr);
-        _if_err_die("eval!clSetKernelArg(3) failed");
-        err = clSetKernelArg(kernels.eval, 4, sizeof(cl_mem), &buffers.eval_data);
-        _if_err_die("eval!clSetKernelArg(4) failed");
-        err = clSetKernelArg(kernels.eval, 5, params->eval_params.local_data_size, NULL);
-        _if_err_die("eval!clSetKernelArg(5) failed");
-
-        cl_event eval_mut_evt;
-        err = clEnqueueNDRangeKernel(queue, kernels.eval, 1, NULL, &eval_glb_work,
-            eval_loc_work_ptr, 1, &mutate_evt, &eval_mut_evt);
-        _if_err_die("eval!clEnqueueNDRangeKernel() failed");
+    // Make sure no command is still pending, also if we bailed out half way through enqueueing.
+    clFinish(de->queue);
 
-        //
-        // Select the better members out of both populations.
-        //
+    snapshot_release(&snap);
 
-        err = clSetKernelArg(kernels.select, 0, sizeof(cl_mem), &buffers.pop[p_cand]);
-        _if_err_die("select!clSetKernelArg(0) failed");
-        err = clSetKernelArg(kernels.select, 1, sizeof(cl_mem), &buffers.costs[p_cand]);
-        _if_err_die("select!clSetKernelArg(1) failed");
-        err = clSetKernelArg(kernels.select, 2, sizeof(cl_mem), &buffers.pop[1]);
-        _if_err_die("select!clSetKernelArg(2) failed");
-        err = clSetKernelArg(kernels.select, 3, sizeof(cl_mem), &buffers.costs[1]);
-        _if_err_die("select!clSetKernelArg(3) failed");
-        err = clSetKernelArg(kernels.select, 4, sizeof(cl_mem), &buffers.pop[p_res]);
-        _if_err_die("select!clSetKernelArg(4) failed");
-        err = clSetKernelArg(kernels.select, 5, sizeof(cl_mem), &buffers.costs[p_res]);
-        _if_err_die("select!clSetKernelArg(5) failed");
-        err = clSetKernelArg(kernels.select, 6, sizeof(cl_uint), &params->num_pop);
-        _if_err_die("select!clSetKernelArg(6) failed");
-        err = clSetKernelArg(kernels.select, 7, sizeof(cl_uint), &params->num_attr);
-        _if_err_die("select!clSetKernelArg(7) failed");
-
-        cl_event wait_for_eval[2];
-        wait_for_eval[0] = eval_evt;
-        wait_for_eval[1] = eval_mut_evt;
-
-        err = clEnqueueNDRangeKernel(queue, kernels.select, 1, NULL, &pop_dim, NULL, 2,
-            wait_for_eval, &select_evt);
-        _if_err_die("select!clEnqueueNDRangeKernel() failed");
-    }
-
-    clFlush(queue);
-    clFinish(queue);
+    if (de->profiling) {
+        finish_profile(de, params, &de, 1);
+    }
 
-    //
-    // Determine the index of the best population member (i.e. the one with least cost).
-    //
+    if (NULL != last) {
+        clReleaseEvent(last);
+        last = NULL;
+    }
+    if (NULL != pending) {
+        clReleaseEvent(pending);
+        pending = NULL;
+    }
+
+    return last_error;
+}
+
+int diffevo_run_batch(diffevo_t *de, const diffevo_params_t *params,
+    const diffevo_problem_t *problems, unsigned num_problems, double *best, double *cost) {
+    if (NULL == de) {
+        report_error("Handle not specified");
+        return -1;
+    }
+    if (0 != InterlockedCompareExchange(&de->busy, 1, 0)) {
+        report_error("The handle is busy with another run");
+        return -1;
+    }
+
+    InterlockedExchange(&de->cancel, 0);
+
+    const int err = run_batch(de, params, problems, num_problems, best, cost);
+
+    InterlockedExchange(&de->busy, 0);
+
+    return err;
+}
+
+struct diffevo_async {
+    diffevo_t *de;
+
+    // Copies of the arguments of diffevo_run_async().
+    diffevo_params_t params;
+    diffevo_problem_t *problems;
+    unsigned num_problems;
+    double *best, *cost;
+
+    // Worker thread and the result of run_batch(), valid once the thread has finished.
+    HANDLE thread;
+    int result;
+};
+
+unsigned __stdcall async_main(void *arg) {
+    diffevo_async_t *run = arg;
+
+    run->result = run_batch(run->de, &run->params, run->problems, run->num_problems, run->best,
+        run->cost);
+
+    return 0;
+}
+
+int diffevo_run_async(diffevo_t *de, const diffevo_params_t *params,
+    const diffevo_problem_t *problems, unsigned num_problems, double *best, double *cost,
+    diffevo_async_t **run) {
+    if (NULL == de || NULL == run) {
+        report_error("Handle or run pointer not specified");
+        return -1;
+    }
 
-    // As with p_cand and p_res, depending on the number of iterations the last iterations output
-    // buffer could be swapped.
-    const unsigned p_fin = (params->num_iter % 2 == 0) ? 0 : 2;
+    last_error = 0;
+    *run = NULL;
+
+    // Invalid parameters are reported right away, and not only by diffevo_wait().
+    if (0 != check_params(params, problems, num_problems)) {
+        return -1;
+    }
 
-    double *costs = malloc(params->num_pop * sizeof(double));
-    if (NULL == costs) {
+    diffevo_async_t *r = calloc(1, sizeof(diffevo_async_t));
+    diffevo_problem_t *copy = malloc(num_problems * sizeof(diffevo_problem_t));
+    if (NULL == r || NULL == copy) {
+        free(r);
+        free(copy);
         report_error("Out of memory");
-        goto __CleanUp;
+        return -1;
     }
 
-    err = clEnqueueReadBuffer(queue, buffers.costs[p_fin], CL_TRUE, 0,
-        params->num_pop * sizeof(double), costs, 0, NULL, NULL);
+    memcpy(copy, problems, num_problems * sizeof(diffevo_problem_t));
+    r->de = de;
+    r->params = *params;
+    r->problems = copy;
+    r->num_problems = num_problems;
+    r->best = best;
+    r->cost = cost;
 
-    if (CL_SUCCESS != err) {
-        free(costs);
-        costs = NULL;
+    if (0 != InterlockedCompareExchange(&de->busy, 1, 0)) {
+        free(r);
+        free(copy);
+        report_error("The handle is busy with another run");
+        return -1;
+    }
 
-        report_error("clEnqueueReadBuffer() failed");
-        goto __CleanUp;
+    InterlockedExchange(&de->cancel, 0);
+    de->async = 1;
+
+    r->thread = (HANDLE) _beginthreadex(NULL, 0, async_main, r, 0, NULL);
+    if (NULL == r->thread) {
+        de->async = 0;
+        InterlockedExchange(&de->busy, 0);
+        free(r);
+        free(copy);
+        report_error("Failed to start the worker thread");
+        return -1;
+    }
+
+    *run = r;
+    return 0;
+}
+
+int diffevo_poll(const diffevo_async_t *run) {
+    if (NULL == run) {
+        report_error("Run not specified");
+        return -1;
     }
 
-    double best_c = costs[0];
-    unsigned best_i = 0;
+    const DWORD res = WaitForSingleObject(run->thread, 0);
+    if (WAIT_OBJECT_0 == res) {
+        return 1;
+    }
+    if (WAIT_TIMEOUT == res) {
+        return 0;
+    }
 
-    for (unsigned i = 1; i < params->num_pop; i++) {
-        if (costs[i] < best_c) {
-            best_c = costs[i];
-            best_i = i;
-        }
+    report_error("Failed to query the worker thread");
+    return -1;
+}
+
+int diffevo_cancel(diffevo_async_t *run) {
+    if (NULL == run) {
+        report_error("Run not specified");
+        return -1;
     }
 
-    free(costs);
-    costs = NULL;
+    InterlockedExchange(&run->de->cancel, 1);
 
-    //
-    // Read the attributes of the best member back from the buffer into the application memory.
-    //
+    return 0;
+}
+
+int diffevo_wait(diffevo_async_t *run) {
+    if (NULL == run) {
+        report_error("Run not specified");
+        return -1;
+    }
+
+    if (WAIT_OBJECT_0 != WaitForSingleObject(run->thread, INFINITE)) {
+        report_error("Failed to wait for the worker thread");
+        return -1;
+    }
+
+    CloseHandle(run->thread);
+
+    diffevo_t *de = run->de;
+    de->async = 0;
+    InterlockedExchange(&de->busy, 0);
+
+    last_error = run->result;
+
+    free(run->problems);
+    free(run);
+
+    return last_error;
+}
+
+// Runs the Philox known-answer vectors through philox_check() on the device of a handle.
+int check_philox_device(diffevo_t *de) {
+    cl_int err;
+
+    unsigned in[PHILOX_KAT_COUNT * 6];
+    unsigned out[PHILOX_KAT_COUNT * 4];
+    for (unsigned v = 0; v < PHILOX_KAT_COUNT; v++) {
+        memcpy(in + 6 * v, philox_kat[v], 6 * sizeof(unsigned));
+    }
 
-    err = clEnqueueReadBuffer(queue, buffers.pop[p_fin], CL_TRUE, 0,
-        params->num_attr * sizeof(double), best, 0, NULL, NULL);
+    const cl_uint num_full = PHILOX_KAT_FULL;
+    const size_t glb_work = PHILOX_KAT_COUNT;
+
+    cl_mem in_buf = NULL, out_buf = NULL;
+    cl_kernel kernel = clCreateKernel(de->program, "philox_check", &err);
+    _if_err_die("Failed to create philox_check() kernel");
+
+    in_buf = clCreateBuffer(de->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(in), in,
+        &err);
+    _if_err_die("clCreateBuffer() failed");
+    out_buf = clCreateBuffer(de->context, CL_MEM_WRITE_ONLY, sizeof(out), NULL, &err);
+    _if_err_die("clCreateBuffer() failed");
+
+    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &in_buf);
+    _if_err_die("philox_check!clSetKernelArg(0) failed");
+    err = clSetKernelArg(kernel, 1, sizeof(cl_mem), &out_buf);
+    _if_err_die("philox_check!clSetKernelArg(1) failed");
+    err = clSetKernelArg(kernel, 2, sizeof(cl_uint), &num_full);
+    _if_err_die("philox_check!clSetKernelArg(2) failed");
+
+    err = clEnqueueNDRangeKernel(de->queue, kernel, 1, NULL, &glb_work, NULL, 0, NULL, NULL);
+    _if_err_die("philox_check!clEnqueueNDRangeKernel() failed");
+    err = clEnqueueReadBuffer(de->queue, out_buf, CL_TRUE, 0, sizeof(out), out, 0, NULL, NULL);
     _if_err_die("clEnqueueReadBuffer() failed");
 
-    *cost = best_c;
+    for (unsigned v = 0; v < PHILOX_KAT_COUNT; v++) {
+        if (0 != memcmp(out + 4 * v, philox_kat[v] + 6, 4 * sizeof(unsigned))) {
+            report_error("Philox known-answer check failed on the device");
+            break;
+        }
+    }
 
 __CleanUp:
+    if (NULL != out_buf) {
+        clReleaseMemObject(out_buf);
+    }
+    if (NULL != in_buf) {
+        clReleaseMemObject(in_buf);
+    }
+    if (NULL != kernel) {
+        clReleaseKernel(kernel);
+    }
 
-    err = destroy_cl();
-    if (0 != err) {
-        report_error("Error while destroying OpenCL context");
+    return 0 != last_error ? -1 : 0;
+}
+
+int diffevo_self_check(diffevo_t *de) {
+    if (NULL == de) {
+        report_error("Handle not specified");
+        return -1;
+    }
+    if (0 != InterlockedCompareExchange(&de->busy, 1, 0)) {
+        report_error("The handle is busy with another run");
         return -1;
     }
 
-    return last_error;
+    last_error = 0;
+
+    // The host implementation is used by the native backend, and is the reference the device has
+    // to agree with.
+    for (unsigned v = 0; v < PHILOX_KAT_COUNT && 0 == last_error; v++) {
+        const unsigned *kat = philox_kat[v];
+        unsigned res[4];
+
+        if (v < PHILOX_KAT_FULL) {
+            philox4x32(kat, kat + 4, res);
+        } else {
+            philox_block(kat[0], kat[1], kat[2], res);
+        }
+
+        if (0 != memcmp(res, kat + 6, sizeof(res))) {
+            report_error("Philox known-answer check failed on the host");
+        }
+    }
+
+    if (0 == last_error && DIFFEVO_BACKEND_OPENCL == de->backend) {
+        if (0 == de->num_islands) {
+            check_philox_device(de);
+        }
+        for (unsigned i = 0; i < de->num_islands && 0 == last_error; i++) {
+            check_philox_device(de->islands[i]);
+        }
+    }
+
+    InterlockedExchange(&de->busy, 0);
+
+    return 0 != last_error ? -1 : 0;
+}
+
+int diffevo_stats(const diffevo_t *de, diffevo_stats_t *stats) {
+    if (NULL == de || NULL == stats) {
+        report_error("Handle or stats not specified");
+        return -1;
+    }
+
+    *stats = de->stats;
+
+    return 0;
+}
+
+int diffevo_solve(const char *path, const diffevo_params_t *params, double *best, double *cost) {
+    diffevo_t *de;
+
+    if (0 != diffevo_create(path, params, &de)) {
+        return -1;
+    }
+
+    const int err = diffevo_run(de, params, best, cost);
+
+    if (0 != diffevo_release(de)) {
+        return -1;
+    }
+
+    return err;
 }
@@ -1,4 +1,6 @@
 // Trick that allows us to directly include this file into diffevo.c as string.
+// Note, that the macro argument must not contain commas outside of parentheses (e.g. declare
+// variables one at a time) nor preprocessor directives.
 #ifndef _s
 #define _s(x)
 #endif
@@ -51,87 +53,600 @@ unsigned mt32_unsigned(mt32_t *r) {
     return t0;
 }
 
-double mt32_double(mt32_t *r) {
-    return mt32_unsigned(r) * (1.0 / 4294967296.0);
+real_t mt32_real(mt32_t *r) {
+    return DIFFEVO_TO_REAL(mt32_unsigned(r));
+}
+
+//
+// Integer hash (lowbias32 by Chris Wellons), used to derive many independent random numbers from
+// a single draw of the RNG without walking its sequence.
+//
+
+unsigned hash32(unsigned x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+real_t hash32_real(unsigned salt, unsigned i) {
+    return DIFFEVO_TO_REAL(hash32(salt ^ hash32(i)));
+}
+
+//
+// Philox4x32-10 counter-based RNG (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3").
+// Draw i of a member in generation gen is a pure function of (seed of the member, gen, i), so
+// nothing has to be loaded or stored between generations, and every kernel variant can compute
+// any draw directly. Selected with DIFFEVO_PHILOX, see the rng_* macros.
+//
+
+// The full Philox4x32-10 bijection of the counter ctr under the key, see philox_check().
+void philox4x32(const unsigned *ctr, const unsigned *key, unsigned *out) {
+    unsigned c0 = ctr[0];
+    unsigned c1 = ctr[1];
+    unsigned c2 = ctr[2];
+    unsigned c3 = ctr[3];
+    unsigned k0 = key[0];
+    unsigned k1 = key[1];
+
+    for(int i = 0; i < 10; i++) {
+        const unsigned hi0 = mul_hi(0xd2511f53u, c0);
+        const unsigned lo0 = 0xd2511f53u * c0;
+        const unsigned hi1 = mul_hi(0xcd9e8d57u, c2);
+        const unsigned lo1 = 0xcd9e8d57u * c2;
+        c0 = hi1 ^ c1 ^ k0;
+        c1 = lo1;
+        c2 = hi0 ^ c3 ^ k1;
+        c3 = lo0;
+        k0 += 0x9e3779b9u;
+        k1 += 0xbb67ae85u;
+    }
+
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+// Block of four draws of a member (keyed by its seed) in generation gen.
+void philox_block(unsigned key, unsigned gen, unsigned block, unsigned *out) {
+    unsigned ctr[4];
+    unsigned k[2];
+    ctr[0] = block;
+    ctr[1] = gen;
+    ctr[2] = 0;
+    ctr[3] = 0;
+    k[0] = key;
+    k[1] = 0x5bd1e995u;
+    philox4x32(ctr, k, out);
+}
+
+// Known-answer check of Philox (one work item per test vector), see diffevo_self_check(). Every
+// vector has six inputs in in: the counter and key of philox4x32() for the first num_full ones,
+// the key, generation and block of philox_block() for the others. out receives the four outputs.
+__kernel void philox_check(
+    __global const unsigned *restrict in,
+    __global unsigned *restrict out,
+    unsigned num_full
+) {
+    const unsigned id = get_global_id(0);
+
+    unsigned ctr[4];
+    unsigned key[2];
+    unsigned res[4];
+
+    if (id < num_full) {
+        for(unsigned i = 0; i < 4; i++) {
+            ctr[i] = in[6 * id + i];
+        }
+        key[0] = in[6 * id + 4];
+        key[1] = in[6 * id + 5];
+        philox4x32(ctr, key, res);
+    } else {
+        philox_block(in[6 * id], in[6 * id + 1], in[6 * id + 2], res);
+    }
+
+    for(unsigned i = 0; i < 4; i++) {
+        out[4 * id + i] = res[i];
+    }
+}
+
+// Sequential view of the draws of one member in one generation, so that Philox can be used like
+// the TinyMT32 state.
+typedef struct {
+    unsigned key;
+    unsigned gen;
+    unsigned n;
+    unsigned buf[4];
+} philox_t;
+
+void philox_load(philox_t *r, unsigned key, unsigned gen) {
+    r->key = key;
+    r->gen = gen;
+    r->n = 0;
+}
+
+unsigned philox_unsigned(philox_t *r) {
+    if (0 == (r->n & 3)) {
+        philox_block(r->key, r->gen, r->n >> 2, r->buf);
+    }
+    return r->buf[r->n++ & 3];
+}
+
+real_t philox_real(philox_t *r) {
+    return DIFFEVO_TO_REAL(philox_unsigned(r));
+}
+
+// Draw i of a member in generation gen, without drawing the ones before it.
+unsigned philox_unsigned_at(unsigned key, unsigned gen, unsigned i) {
+    unsigned buf[4];
+    philox_block(key, gen, i >> 2, buf);
+    return buf[i & 3];
+}
+
+real_t philox_real_at(unsigned key, unsigned gen, unsigned i) {
+    return DIFFEVO_TO_REAL(philox_unsigned_at(key, gen, i));
 }
 
 //
 // Differential Evolution (DE) algorithm implementation
 //
+// The members of a batch (see diffevo_run_batch()) are stored problem after problem, i.e. member
+// id belongs to problem id / num_pop. Every kernel only ever mixes members of the same problem, so
+// a single launch advances all problems at once.
+//
+// The random numbers are drawn through the rng_* macros, i.e. either from a TinyMT32 state per
+// member that is loaded and stored by every kernel, or from Philox keyed by the seed of the member
+// (DIFFEVO_PHILOX). gen is the generation a kernel computes, starting with 1 (init() is 0). With
+// Philox, all kernel variants (and the native backend) use the same draws: the three donors, then
+// one draw per attribute for the crossover, then one per attribute for re-sampling it into its
+// bounds (only drawn if needed), then the attribute that is always taken from the mutant
+// (DIFFEVO_FORCE_MUTANT, see _mutant_index()), then the fourth and fifth donor (DIFFEVO_STRATEGY
+// 3), then four draws for the control parameters (DIFFEVO_ADAPT, see adapt_ctrl()). The draws
+// after the ones per attribute are made through rng_extra.
+//
+// The mutant is formed by _mutant() from the donors, which are distinct from each other and from
+// the member itself (see pick_donor()), and for some strategies from the best member of the
+// problem, i.e. its attributes in the status written by reduce() (or the local population in the
+// persistent kernel).
+//
+// mutate() flags every trial that differs from its parent, so that the host evaluation can skip
+// the others (see enqueue_host_eval()). The fused kernels skip them right away.
+//
+// With bounds (DIFFEVO_BOUNDS), the bounds argument holds the lower bounds of all attributes
+// followed by the upper ones. init() then draws uniformly within them, and every trial attribute
+// that leaves them is repaired through _repair(), see repair().
+//
+
+// Moves attribute value x back into [lo, hi], u is a uniform draw for re-sampling. A reflection
+// that overshoots the opposite bound is clamped.
+real_t repair(real_t x, real_t lo, real_t hi, real_t u) {
+    if (2 == _repair_mode) {
+        return lo + u * (hi - lo);
+    }
+    if (1 == _repair_mode) {
+        x = x < lo ? 2 * lo - x : 2 * hi - x;
+    }
+    return fmin(fmax(x, lo), hi);
+}
+
+// Index of a donor within the population drawn from d, which differs from the member t itself and
+// the donors e0 to e3 drawn before it (UINT_MAX if there are fewer). Collisions are drawn anew by
+// rehashing d, so that the donor stays a function of the draw alone (and the native backend picks
+// the same). Requires more members than indices to avoid, see check_params().
+unsigned pick_donor(unsigned d, unsigned num_pop, unsigned t, unsigned e0, unsigned e1,
+    unsigned e2, unsigned e3) {
+    unsigned n = d % _num_pop;
+
+    for(unsigned i = 0; n == t || n == e0 || n == e1 || n == e2 || n == e3; i++) {
+        // A cycle of the hash that only hits taken members is unlikely, but would never end.
+        d = hash32(d);
+        n = i < 16 ? d % _num_pop : (n + 1) % _num_pop;
+    }
+
+    return n;
+}
+
+// Draws the donors of member t (indices within its population) into d. The fourth and fifth one
+// are only drawn for DIFFEVO_STRATEGY 3 (and zero otherwise).
+void draw_donors(rng_t *r, unsigned num_pop, unsigned num_attr, unsigned t, unsigned *d) {
+    d[0] = pick_donor(rng_unsigned(r), num_pop, t, UINT_MAX, UINT_MAX, UINT_MAX, UINT_MAX);
+    d[1] = pick_donor(rng_unsigned(r), num_pop, t, d[0], UINT_MAX, UINT_MAX, UINT_MAX);
+    d[2] = pick_donor(rng_unsigned(r), num_pop, t, d[0], d[1], UINT_MAX, UINT_MAX);
+    d[3] = 0;
+    d[4] = 0;
+
+    if (5 == _num_donors) {
+        d[3] = pick_donor(rng_extra(r, 1), num_pop, t, d[0], d[1], d[2], UINT_MAX);
+        d[4] = pick_donor(rng_extra(r, 2), num_pop, t, d[0], d[1], d[2], d[3]);
+    }
+}
+
+// Replaces the shrink factor f and crossover probability cr of the trial of member id by adapted
+// ones (DIFFEVO_ADAPT), nothing is drawn without. With jDE (1), ctrl holds the pair of every
+// member, which the trial renews with probability 0.1 each (Brest et al., "Self-Adapting Control
+// Parameters in Differential Evolution"). With SHADE (2), ctrl holds the memory of every problem
+// (_memory_size pairs, followed by the next entry to update of every problem, see adapt()), around
+// a random entry of which f is drawn Cauchy and cr Normal distributed (Tanabe and Fukunaga,
+// "Success-History Based Parameter Adaptation for Differential Evolution").
+void adapt_ctrl(rng_t *r, __global const real_t *ctrl, unsigned id, unsigned num_pop,
+    unsigned num_attr, real_t *f, real_t *cr) {
+    if (0 == _adapt_mode) {
+        return;
+    }
+
+    const unsigned d0 = rng_extra(r, 3);
+    const unsigned d1 = rng_extra(r, 4);
+    const real_t x = DIFFEVO_TO_REAL(rng_extra(r, 5));
+    const real_t y = DIFFEVO_TO_REAL(rng_extra(r, 6));
+
+    if (1 == _adapt_mode) {
+        *f = DIFFEVO_TO_REAL(d0) < 0.1 ? 0.1 + 0.9 * DIFFEVO_TO_REAL(d1) : ctrl[2 * id];
+        *cr = x < 0.1 ? y : ctrl[2 * id + 1];
+        return;
+    }
+
+    const unsigned k = 2 * (DIFFEVO_PROBLEM(id) * _memory_size + d0 % _memory_size);
+
+    // Non-positive shrink factors are drawn anew, larger ones than 1 are truncated.
+    real_t s = 0;
+    for(unsigned i = 0; s <= 0 && i < 64; i++) {
+        s = ctrl[k] + 0.1 * tan(_pi * (hash32_real(d1, i) - 0.5));
+    }
+    *f = s > 0 ? fmin(s, (real_t) 1) : ctrl[k];
+
+    // Box-Muller method, like init().
+    const real_t z = sqrt(-2 * log(1 - x)) * cos(2 * _pi * y);
+    *cr = fmin(fmax(ctrl[k + 1] + 0.1 * z, (real_t) 0), (real_t) 1);
+}
+
+// Records the outcome of the trial of member id that used the control parameters f and cr, gain
+// being how much it improved on the cost of the member. jDE keeps the parameters of a trial that
+// replaced its member, SHADE collects all of them for adapt().
+void adapt_record(__global real_t *ctrl, __global real_t *trial, unsigned id, real_t f,
+    real_t cr, bool won, real_t gain) {
+    if (1 == _adapt_mode && won) {
+        ctrl[2 * id] = f;
+        ctrl[2 * id + 1] = cr;
+    }
+
+    if (2 == _adapt_mode) {
+        // Ties and the replacement of infeasible members (infinite gain) carry no weight.
+        trial[3 * id] = f;
+        trial[3 * id + 1] = cr;
+        trial[3 * id + 2] = won && isfinite(gain) ? gain : 0;
+    }
+}
 
 __kernel void init(
-    __global mt32_t *restrict rng,
-    __constant unsigned *restrict seeds,
-    __global double *restrict pop,
+    DIFFEVO_RNG_STATE *restrict rng,
+    DIFFEVO_CONST unsigned *restrict seeds,
+    __global real_t *restrict pop,
     unsigned num_pop,
     unsigned num_attr,
-    double mu,
-    double sigma
+    DIFFEVO_CONST real_t *restrict dist,
+    DIFFEVO_CONST real_t *restrict bounds,
+    __global const real_t *restrict warm,
+    __global const unsigned *restrict num_warm
 ) {
     const unsigned id = get_global_id(0);
 
-    mt32_t r;
-    mt32_init(&r, seeds[id]);
+    // Every problem has its own initial distribution, stored as (mu, sigma) pairs.
+    const real_t mu = dist[2 * (id / _num_pop)];
+    const real_t sigma = dist[2 * (id / _num_pop) + 1];
+
+    // The first num_warm members of every problem are given by the host (one member after
+    // another). They still make their draws, so that the others stay the same.
+    const bool is_warm = id % _num_pop < num_warm[id / _num_pop];
+
+    rng_t r;
+    rng_init(&r, seeds[id]);
 
-    for(unsigned a = 0; a < num_attr; a++) {
-        // Box-Muller method to generate a Normal(mu, sigma^2) distributed number.
-        const double x = mt32_double(&r);
-        const double y = mt32_double(&r);
-        const double z = mu + sigma * sqrt(-2.0 * log(x)) * cos(2.0 * M_PI * y);
-        pop[id * num_attr + a] = z;
+    for(unsigned a = 0; a < _num_attr; a++) {
+        // Box-Muller method to generate a Normal(mu, sigma^2) distributed number. The draws
+        // are in [0, 1), so use 1 - x to keep log() finite.
+        const real_t x = rng_real(&r);
+        const real_t y = rng_real(&r);
+        const real_t z = mu + sigma * sqrt(-2 * log(1 - x)) * cos(2 * _pi * y);
+        DIFFEVO_POP(pop, id, a) = is_warm ? warm[id * _num_attr + a] : _init_attr(z, bounds, a, x);
     }
 
-    rng[id] = r;
+    rng_store(rng, id, &r);
 }
 
 __kernel void mutate(
-    __global mt32_t *restrict rng,
-    __constant double *restrict in_pop,
-    __global double *restrict out_pop,
+    DIFFEVO_RNG_STATE *restrict rng,
+    DIFFEVO_CONST real_t *restrict in_pop,
+    __global real_t *restrict out_pop,
     unsigned num_pop,
     unsigned num_attr,
-    double shrink,
-    double crossover
+    real_t shrink,
+    real_t crossover,
+    unsigned gen,
+    DIFFEVO_CONST real_t *restrict bounds,
+    __global uchar *restrict flags,
+    __global const real_t *restrict status,
+    __global const real_t *restrict ctrl,
+    __global real_t *restrict trial
 ) {
+    // With DIFFEVO_ADAPT, the control parameters of every trial are passed on to select() through
+    // trial (three reals per member, see adapt_record()).
     const unsigned id = get_global_id(0);
-    const unsigned t = id * num_attr;
+    const unsigned base = id - id % _num_pop;
+
+    rng_t r;
+    rng_load(&r, rng, id, gen);
+
+    unsigned d[5];
+    draw_donors(&r, num_pop, num_attr, id - base, d);
 
-    mt32_t r = rng[id];
+    const unsigned u = base + d[0];
+    const unsigned v = base + d[1];
+    const unsigned w = base + d[2];
+    const unsigned v2 = base + d[3];
+    const unsigned w2 = base + d[4];
+    const unsigned j = _mutant_index(rng_forced(&r));
 
-    const unsigned u = (mt32_unsigned(&r) % num_pop) * num_attr;
-    const unsigned v = (mt32_unsigned(&r) % num_pop) * num_attr;
-    const unsigned w = (mt32_unsigned(&r) % num_pop) * num_attr;
+    real_t f = _shrink;
+    real_t cr = _crossover;
+    adapt_ctrl(&r, ctrl, id, num_pop, num_attr, &f, &cr);
 
-    for(unsigned a = 0; a < num_attr; a++) { 
-        const double p = in_pop[t + a];
-        const double q = in_pop[u + a] + shrink * (in_pop[v + a] - in_pop[w + a]);
-        out_pop[t + a] = mt32_double(&r) >= crossover ? p : q;
+    bool changed = false;
+
+    for(unsigned a = 0; a < _num_attr; a++) {
+        const real_t p = DIFFEVO_POP(in_pop, id, a);
+        const real_t q = _mutant(p, _best(status, id, a), DIFFEVO_POP(in_pop, u, a),
+            DIFFEVO_POP(in_pop, v, a), DIFFEVO_POP(in_pop, w, a), DIFFEVO_POP(in_pop, v2, a),
+            DIFFEVO_POP(in_pop, w2, a), f);
+        const real_t y = rng_real(&r) >= cr && a != j ? p : q;
+        const real_t x = _repair(y, bounds, a, rng_resample(&r, a));
+        DIFFEVO_POP(out_pop, id, a) = x;
+        changed |= x != p;
     }
 
-    rng[id] = r;
+    rng_store(rng, id, &r);
+
+    flags[id] = changed;
+
+    if (0 != _adapt_mode) {
+        trial[3 * id] = f;
+        trial[3 * id + 1] = cr;
+    }
 }
 
 __kernel void select(
-    __constant double *restrict in1_pop,
-    __constant double *restrict in1_cost,
-    __constant double *restrict in2_pop,
-    __constant double *restrict in2_cost,
-    __global double *restrict out_pop,
-    __global double *restrict out_cost,
+    DIFFEVO_CONST real_t *restrict in1_pop,
+    DIFFEVO_CONST real_t *restrict in1_cost,
+    DIFFEVO_CONST real_t *restrict in2_pop,
+    DIFFEVO_CONST real_t *restrict in2_cost,
+    __global real_t *restrict out_pop,
+    __global real_t *restrict out_cost,
     unsigned num_pop,
-    unsigned num_attr
+    unsigned num_attr,
+    __global real_t *restrict ctrl,
+    __global real_t *restrict trial
 ) {
     const unsigned id = get_global_id(0);
-    const unsigned t = id * num_attr;
 
     const bool better_1 = in1_cost[id] < in2_cost[id];
 
-    for(unsigned a = 0; a < num_attr; a++) {
-        const unsigned ta = t + a;
-        out_pop[ta] = better_1 ? in1_pop[ta] : in2_pop[ta];
+    for(unsigned a = 0; a < _num_attr; a++) {
+        DIFFEVO_POP(out_pop, id, a) = better_1 ? DIFFEVO_POP(in1_pop, id, a)
+            : DIFFEVO_POP(in2_pop, id, a);
     }
 
     out_cost[id] = better_1 ? in1_cost[id] : in2_cost[id];
+
+    if (0 != _adapt_mode) {
+        adapt_record(ctrl, trial, id, trial[3 * id], trial[3 * id + 1], !better_1,
+            in1_cost[id] - in2_cost[id]);
+    }
+}
+
+//
+// Variants of mutate() and select() for high-dimensional problems, launched with one work group
+// per member (dimension 1) whose work items split the attributes (dimension 0).
+//
+
+__kernel void mutate_2d(
+    DIFFEVO_RNG_STATE *restrict rng,
+    DIFFEVO_CONST real_t *restrict in_pop,
+    __global real_t *restrict out_pop,
+    unsigned num_pop,
+    unsigned num_attr,
+    real_t shrink,
+    real_t crossover,
+    unsigned gen,
+    DIFFEVO_CONST real_t *restrict bounds,
+    __global uchar *restrict flags,
+    __global const real_t *restrict status
+) {
+    // Never used with DIFFEVO_ADAPT, see is_high_dim().
+    const unsigned id = get_global_id(1);
+    const unsigned lid = get_local_id(0);
+    const unsigned n = get_local_size(0);
+    const unsigned base = id - id % _num_pop;
+
+    // The donors and a salt for the crossover decisions are drawn once per member, the work items
+    // then derive the decision for their attributes from the salt (or, with Philox, compute the
+    // draw of their attributes directly).
+    __local unsigned l_draw[7];
+    __local int l_changed;
+
+    if (0 == lid) {
+        rng_t r;
+        rng_load(&r, rng, id, gen);
+        unsigned d[5];
+        draw_donors(&r, num_pop, num_attr, id - base, d);
+        for(unsigned i = 0; i < 5; i++) {
+            l_draw[i] = base + d[i];
+        }
+        l_draw[5] = rng_unsigned(&r);
+        l_draw[6] = _mutant_index(rng_forced(&r));
+        rng_store(rng, id, &r);
+        l_changed = 0;
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    const unsigned u = l_draw[0];
+    const unsigned v = l_draw[1];
+    const unsigned w = l_draw[2];
+    const unsigned v2 = l_draw[3];
+    const unsigned w2 = l_draw[4];
+    const unsigned salt = l_draw[5];
+    const unsigned j = l_draw[6];
+
+    bool changed = false;
+
+    for(unsigned a = lid; a < _num_attr; a += n) {
+        const real_t p = DIFFEVO_POP(in_pop, id, a);
+        const real_t q = _mutant(p, _best(status, id, a), DIFFEVO_POP(in_pop, u, a),
+            DIFFEVO_POP(in_pop, v, a), DIFFEVO_POP(in_pop, w, a), DIFFEVO_POP(in_pop, v2, a),
+            DIFFEVO_POP(in_pop, w2, a), _shrink);
+        const real_t y = rng_crossover(rng, id, gen, salt, a) >= _crossover && a != j ? p : q;
+        const real_t x = _repair(y, bounds, a, rng_resample_at(rng, id, gen, salt, a));
+        DIFFEVO_POP(out_pop, id, a) = x;
+        changed |= x != p;
+    }
+
+    if (changed) {
+        atomic_or(&l_changed, 1);
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (0 == lid) {
+        flags[id] = 0 != l_changed;
+    }
+}
+
+__kernel void select_2d(
+    DIFFEVO_CONST real_t *restrict in1_pop,
+    DIFFEVO_CONST real_t *restrict in1_cost,
+    DIFFEVO_CONST real_t *restrict in2_pop,
+    DIFFEVO_CONST real_t *restrict in2_cost,
+    __global real_t *restrict out_pop,
+    __global real_t *restrict out_cost,
+    unsigned num_pop,
+    unsigned num_attr
+) {
+    const unsigned id = get_global_id(1);
+    const unsigned lid = get_local_id(0);
+    const unsigned n = get_local_size(0);
+
+    const bool better_1 = in1_cost[id] < in2_cost[id];
+
+    for(unsigned a = lid; a < _num_attr; a += n) {
+        DIFFEVO_POP(out_pop, id, a) = better_1 ? DIFFEVO_POP(in1_pop, id, a)
+            : DIFFEVO_POP(in2_pop, id, a);
+    }
+
+    if (0 == lid) {
+        out_cost[id] = better_1 ? in1_cost[id] : in2_cost[id];
+    }
+}
+
+__kernel void reduce(
+    DIFFEVO_CONST real_t *restrict pop,
+    DIFFEVO_CONST real_t *restrict costs,
+    __global real_t *restrict status,
+    unsigned num_pop,
+    unsigned num_attr,
+    __local real_t *restrict l_min,
+    __local real_t *restrict l_max,
+    __local unsigned *restrict l_idx
+) {
+    // Launched as one work group per problem whose size is a power of two. Writes the maximum
+    // cost, the minimum cost, the index of the best member and its attributes into the status of
+    // the problem (in this order, so that the host can read the best member in one go).
+    const unsigned id = get_local_id(0);
+    const unsigned n = get_local_size(0);
+    const unsigned base = get_group_id(0) * _num_pop;
+
+    status += get_group_id(0) * (3 + _num_attr);
+
+    real_t c_min = INFINITY;
+    real_t c_max = -INFINITY;
+    unsigned i_min = 0;
+
+    for(unsigned i = id; i < _num_pop; i += n) {
+        const real_t c = costs[base + i];
+        if (c < c_min) {
+            c_min = c;
+            i_min = i;
+        }
+        c_max = fmax(c_max, c);
+    }
+
+    l_min[id] = c_min;
+    l_max[id] = c_max;
+    l_idx[id] = i_min;
+
+    for(unsigned s = n / 2; s > 0; s /= 2) {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (id < s) {
+            // Prefer the lower index on ties, so that the result does not depend on n.
+            const real_t o_min = l_min[id + s];
+            const unsigned o_idx = l_idx[id + s];
+            if (o_min < l_min[id] || (o_min == l_min[id] && o_idx < l_idx[id])) {
+                l_min[id] = o_min;
+                l_idx[id] = o_idx;
+            }
+            l_max[id] = fmax(l_max[id], l_max[id + s]);
+        }
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    const unsigned best = l_idx[0];
+
+    if (0 == id) {
+        status[0] = l_max[0];
+        status[1] = l_min[0];
+        status[2] = best;
+    }
+
+    for(unsigned a = id; a < _num_attr; a += n) {
+        status[3 + a] = DIFFEVO_POP(pop, base + best, a);
+    }
+}
+
+// Updates the SHADE memory (DIFFEVO_ADAPT 2) of every problem (one work item each) after select()
+// or generation(): the next entry becomes the Lehmer mean of the shrink factors and the mean of the
+// crossover probabilities of the trials that improved on their member, weighted by their gain. As
+// in the paper, the next entry only advances (in turn) when there was such a trial. It is kept
+// behind the memories of all problems, as a real_t, which holds an index below num_pop exactly.
+__kernel void adapt(
+    __global real_t *restrict ctrl,
+    __global const real_t *restrict trial,
+    unsigned num_pop
+) {
+    const unsigned p = get_global_id(0);
+    const unsigned next = 2 * get_global_size(0) * _memory_size + p;
+
+    real_t s_w = 0;
+    real_t s_f = 0;
+    real_t s_f2 = 0;
+    real_t s_cr = 0;
+
+    for(unsigned n = p * _num_pop; n < (p + 1) * _num_pop; n++) {
+        const real_t w = trial[3 * n + 2];
+        s_w += w;
+        s_f += w * trial[3 * n];
+        s_f2 += w * trial[3 * n] * trial[3 * n];
+        s_cr += w * trial[3 * n + 1];
+    }
+
+    if (s_w > 0) {
+        const unsigned e = (unsigned) ctrl[next];
+        const unsigned k = 2 * (p * _memory_size + e);
+        ctrl[k] = s_f2 / s_f;
+        ctrl[k + 1] = s_cr / s_w;
+        ctrl[next] = (e + 1) % _memory_size;
+    }
 }
 
 )
@@ -1,7 +1,92 @@
 #pragma once
 
+// Stopping criteria, see stop_params in diffevo_params_t.
+#define DIFFEVO_STOP_COST 0x1
+#define DIFFEVO_STOP_SPREAD 0x2
+#define DIFFEVO_STOP_STALL 0x4
+#define DIFFEVO_STOP_TIME 0x8
+#define DIFFEVO_STOP_EVALS 0x10
+
+// Stop reason of a run that was cancelled, see diffevo_cancel(). Not a criterion.
+#define DIFFEVO_STOP_CANCELLED 0x20
+
+// Population layouts, see layout in diffevo_params_t.
+#define DIFFEVO_LAYOUT_AOS 0
+#define DIFFEVO_LAYOUT_SOA 1
+
+// Backends, see backend in diffevo_params_t.
+#define DIFFEVO_BACKEND_OPENCL 0
+#define DIFFEVO_BACKEND_NATIVE 1
+
+// Random number generators, see rng in diffevo_params_t.
+#define DIFFEVO_RNG_TINYMT 0
+#define DIFFEVO_RNG_PHILOX 1
+
+// Floating point precision of the kernels, see precision in diffevo_params_t.
+#define DIFFEVO_PRECISION_DOUBLE 0
+#define DIFFEVO_PRECISION_FLOAT 1
+
+// Repair strategies for attributes that leave their bounds, see constraint_params in
+// diffevo_params_t.
+#define DIFFEVO_REPAIR_CLAMP 0
+#define DIFFEVO_REPAIR_REFLECT 1
+#define DIFFEVO_REPAIR_RESAMPLE 2
+
+// Mutation strategies, see strategy in diffevo_params_t.
+#define DIFFEVO_STRATEGY_RAND_1 0
+#define DIFFEVO_STRATEGY_BEST_1 1
+#define DIFFEVO_STRATEGY_CURRENT_TO_BEST_1 2
+#define DIFFEVO_STRATEGY_RAND_2 3
+
+// Adaptation of shrink and crossover, see adapt_params in diffevo_params_t.
+#define DIFFEVO_ADAPT_NONE 0
+#define DIFFEVO_ADAPT_JDE 1
+#define DIFFEVO_ADAPT_SHADE 2
+
+// Device types, see device_type in diffevo_params_t.
+#define DIFFEVO_DEVICE_ANY 0
+#define DIFFEVO_DEVICE_CPU 1
+#define DIFFEVO_DEVICE_GPU 2
+
+// Migration topologies, see island_params in diffevo_params_t.
+#define DIFFEVO_RING 0
+#define DIFFEVO_RING_BIDIRECTIONAL 1
+
+// Command types of the profile, see diffevo_profile_t. The 2D variants count as mutate and select,
+// adapt() counts as select, DIFFEVO_KERNEL_FUSED covers fused_eval() and generation(),
+// DIFFEVO_KERNEL_PERSISTENT covers generations(), and DIFFEVO_KERNEL_TRANSFER the copies and
+// mappings of the host evaluation.
+#define DIFFEVO_KERNEL_INIT 0
+#define DIFFEVO_KERNEL_EVAL 1
+#define DIFFEVO_KERNEL_MUTATE 2
+#define DIFFEVO_KERNEL_SELECT 3
+#define DIFFEVO_KERNEL_REDUCE 4
+#define DIFFEVO_KERNEL_FUSED 5
+#define DIFFEVO_KERNEL_PERSISTENT 6
+#define DIFFEVO_KERNEL_TRANSFER 7
+#define DIFFEVO_NUM_KERNELS 8
+
+// Host phases of the profile, see diffevo_profile_t. DIFFEVO_PHASE_SETUP covers the allocation of
+// the buffers and the upload of the seeds, DIFFEVO_PHASE_READBACK the blocking transfers of the
+// convergence checks, migrations and results, DIFFEVO_PHASE_HOST_EVAL the calls of cost_fn.
+#define DIFFEVO_PHASE_CONTEXT 0
+#define DIFFEVO_PHASE_BUILD 1
+#define DIFFEVO_PHASE_SETUP 2
+#define DIFFEVO_PHASE_READBACK 3
+#define DIFFEVO_PHASE_HOST_EVAL 4
+#define DIFFEVO_NUM_PHASES 5
+
+// Cost function of the native backend, the counterpart of cost() in fused mode. x contains the
+// num_attr attributes of a single candidate, eval_data is the const_data_ptr of its problem.
+typedef double (*diffevo_cost_fn)(const double *x, unsigned num_attr, const void *eval_data);
+
+// Progress callback, see progress_params. gen is the number of generations executed so far, best
+// the best cost (for a batch, the one of the worst problem) and mean the mean cost of all members.
+typedef void (*diffevo_progress_fn)(unsigned gen, double best, double mean, void *user_data);
+
 typedef struct {
-    // Fixed number of iterations the algorithm will execute.
+    // Maximum number of iterations the algorithm will execute. Without stopping criteria (see
+    // stop_params) it always executes exactly this many.
     // e.g. 250; 100 - 10000.
     unsigned num_iter;
 
@@ -53,7 +138,305 @@ typedef struct {
         // data between work groups.
         // 0, if not needed.
         unsigned local_data_size;
+
+        // If non-zero, const_data_ptr is used by the device directly (CL_MEM_USE_HOST_PTR) instead
+        // of being copied, which avoids duplicating large data sets. The data must stay valid and
+        // unchanged until the run has finished. For actual zero-copy, most devices require the
+        // data to be aligned to 4096 bytes and its size to be a multiple of 64 bytes.
+        // 0, if not needed.
+        unsigned zero_copy;
     } eval_params;
+
+    // Allows you to warm-start from known candidates, e.g. the result of a previous run of a
+    // similar problem or a cheap heuristic.
+    struct {
+        // Attributes of num_members candidates (num_attr each, one candidate after another) that
+        // replace the first members of the initial population. The remaining members are drawn
+        // as usual.
+        // NULL, if not needed.
+        const double *pop;
+
+        // Number of candidates in pop, at most num_pop.
+        // 0, if not needed.
+        unsigned num_members;
+
+        // Known costs of the candidates in pop (num_members), which are then used as is instead
+        // of evaluating them (except by an eval() kernel with a local_work_size).
+        // NULL to have them evaluated.
+        const double *costs;
+    } init_params;
+
+    // If non-zero, every trial takes at least one (randomly chosen) attribute from the mutant, as
+    // in classic DE. Otherwise, a trial may equal its parent. Such trials are not evaluated where
+    // the library controls the evaluation (fused mode, cost_fn and the native backend), see
+    // num_evals_saved in diffevo_stats_t, but an eval() kernel evaluates them anyway. Changes the
+    // random numbers drawn, i.e. the result with a fixed seed.
+    // e.g. 1 with an eval() kernel and a low crossover; 0, if not needed.
+    unsigned force_mutant;
+
+    // How the mutant of a member p is formed from the donors u, v, w, ..., which are other members
+    // drawn distinct from each other and from p, and the best member b (with F being shrink):
+    // DIFFEVO_STRATEGY_RAND_1 is u + F (v - w), DIFFEVO_STRATEGY_BEST_1 is b + F (u - v),
+    // DIFFEVO_STRATEGY_CURRENT_TO_BEST_1 is p + F (b - p) + F (u - v), and DIFFEVO_STRATEGY_RAND_2
+    // is u + F (v - w) + F (x - y). The strategies using b converge faster but are more likely to
+    // get stuck, they cost an additional reduction per generation (except for the persistent
+    // kernel). Compiled into the program. Requires num_pop to be at least 4 (6 for
+    // DIFFEVO_STRATEGY_RAND_2).
+    // e.g. DIFFEVO_STRATEGY_CURRENT_TO_BEST_1; DIFFEVO_STRATEGY_RAND_1 (0) by default.
+    unsigned strategy;
+
+    // Allows you to leave the tuning of shrink and crossover to the algorithm, which then only uses
+    // them as initial values. The adapted values are kept in device memory for the whole run.
+    struct {
+        // DIFFEVO_ADAPT_JDE gives every member its own shrink and crossover, which a trial renews
+        // at random (with probability 0.1 each) and which survive if the trial replaces the member.
+        // DIFFEVO_ADAPT_SHADE draws them for every trial around the entries of a memory per
+        // problem, which collects the values of the trials that improved on their member. This is
+        // only the success-history adaptation of SHADE: the mutation stays the one of strategy
+        // (there is no current-to-pbest/1), and there is no archive of replaced members. Not
+        // supported by the persistent kernel and checkpoints, and not used by the high-dimensional
+        // kernels (high_dim_attr). Changes the random numbers drawn.
+        // e.g. DIFFEVO_ADAPT_JDE; DIFFEVO_ADAPT_NONE (0) by default.
+        unsigned mode;
+
+        // DIFFEVO_ADAPT_SHADE: Number of entries of the memory, at most num_pop.
+        // e.g. 10; 0 for the default of 10 (or num_pop, if less).
+        unsigned memory_size;
+    } adapt_params;
+
+    // If non-zero, num_pop, num_attr, shrink and crossover are compiled into the program as
+    // constants (DIFFEVO_NUM_POP, DIFFEVO_NUM_ATTR, DIFFEVO_SHRINK and DIFFEVO_CROSSOVER), which
+    // lets the compiler fully unroll the per-attribute loops. Worthwhile for small, fixed problem
+    // sizes, as changing one of these values on a handle triggers a rebuild.
+    // 0, if not needed.
+    unsigned specialize;
+
+    // If non-zero, every generation runs as a single kernel that mutates, evaluates and selects
+    // without ever writing the trial population to global memory. Instead of the eval() kernel
+    // your source then has to provide an inlinable cost function
+    //     real_t cost(const real_t *x, unsigned num_attr, DIFFEVO_CONST void *eval_data);
+    // Implies compiling num_attr into the program and does not support the local_work_size and
+    // local_data_size eval_params.
+    // 0, if not needed.
+    unsigned fused;
+
+    // In fused mode, the number of generations a single work group runs within one kernel launch,
+    // keeping the population in local memory in between. Reduces the number of launches by this
+    // factor, but only uses a single compute unit. Pays off for small populations (that have to
+    // fit into one work group) and many iterations. Set it to num_iter for a single launch.
+    // e.g. 100; 0, if not needed.
+    unsigned persistent;
+
+    // Memory layout of the population buffers. DIFFEVO_LAYOUT_AOS stores the members one after
+    // another, DIFFEVO_LAYOUT_SOA stores the attributes one after another (padded to the vector
+    // width), so that neighboring work items access neighboring addresses. Access the population
+    // in your eval() kernel through DIFFEVO_POP(pop, n, a), then it works with either layout.
+    // e.g. DIFFEVO_LAYOUT_SOA for many attributes; DIFFEVO_LAYOUT_AOS (0) by default.
+    unsigned layout;
+
+    // Number of attributes from which on mutate() and select() run one work group per member,
+    // whose work items split the attributes among each other (instead of one work item looping
+    // over all attributes). Helps to occupy the device for high-dimensional problems with small
+    // populations. Not used in fused mode.
+    // e.g. 1000; 0 for the default of 512.
+    unsigned high_dim_attr;
+
+    // Seed of the random number generators. A fixed seed makes runs reproducible, see rng. For
+    // diffevo_run_batch() the seeds of the problems are used instead.
+    // e.g. 42; 0 for a random seed.
+    unsigned seed;
+
+    // Random number generator. DIFFEVO_RNG_TINYMT keeps a generator state per member, which every
+    // generation loads and stores. DIFFEVO_RNG_PHILOX computes the random numbers from the seed,
+    // the generation and the member instead (counter-based), which saves this memory traffic and
+    // makes the result with a fixed seed identical for all kernel variants (high_dim_attr, fused,
+    // persistent) and backends, as long as the costs are computed identically.
+    // e.g. DIFFEVO_RNG_PHILOX; DIFFEVO_RNG_TINYMT (0) by default.
+    unsigned rng;
+
+    // Floating point precision of the populations and costs on the device. Both your eval() kernel
+    // (or cost() in fused mode) and the algorithm see it as real_t, i.e. double or float.
+    // DIFFEVO_PRECISION_FLOAT halves the memory traffic and runs at full speed on devices with
+    // little or no double precision support (most consumer GPUs), at the price of about 7
+    // significant digits. Double precision constants in your source are then treated as single
+    // precision ones. The parameters and results stay double either way. Ignored by the native
+    // backend, and not supported together with cost_fn on the OpenCL backend.
+    // e.g. DIFFEVO_PRECISION_FLOAT on consumer GPUs; DIFFEVO_PRECISION_DOUBLE (0) by default.
+    unsigned precision;
+
+    // Backend that runs the algorithm. DIFFEVO_BACKEND_OPENCL runs the kernels on the OpenCL
+    // device, DIFFEVO_BACKEND_NATIVE runs the same algorithm on all cores of the host (without
+    // touching OpenCL at all) and calls cost_fn instead of an eval() kernel. The native backend
+    // ignores the OpenCL specific parameters, i.e. specialize, fused, persistent, layout,
+    // high_dim_attr, cache_dir and the eval_params apart from const_data_ptr. A handle is bound to
+    // the backend it was created with.
+    // e.g. DIFFEVO_BACKEND_NATIVE on machines without GPU; DIFFEVO_BACKEND_OPENCL (0) by default.
+    unsigned backend;
+
+    // Cost function of your problem, evaluated on the host. It is called from multiple threads at
+    // once, so it must not modify shared state. Required by DIFFEVO_BACKEND_NATIVE. With the OpenCL
+    // backend it replaces the eval() kernel (e.g. for cost functions calling into host libraries):
+    // mutate() and select() still run on the device, while the trial members are streamed to the
+    // host in chunks. Not supported in fused mode and with the structure of arrays layout.
+    // NULL, if not needed.
+    diffevo_cost_fn cost_fn;
+
+    // Allows you to stop before num_iter once the population has converged.
+    struct {
+        // Number of generations between two checks of the stopping criteria. The checks require a
+        // small reduction and readback, so checking every generation would stall the device.
+        // e.g. 50; 0, if not needed.
+        unsigned check_interval;
+
+        // Combination of DIFFEVO_STOP_* flags, the first criterion met stops the algorithm.
+        // 0, if not needed.
+        unsigned criteria;
+
+        // DIFFEVO_STOP_COST: Stop once the best cost is less than or equal to this.
+        double cost_target;
+
+        // DIFFEVO_STOP_SPREAD: Stop once the costs of all members are within this tolerance of
+        // each other, i.e. the population has collapsed.
+        double spread_tol;
+
+        // DIFFEVO_STOP_STALL: Stop if the best cost has not improved for this many generations.
+        unsigned stall_gens;
+
+        // DIFFEVO_STOP_TIME: Stop after this many seconds of wall-clock time.
+        double time_budget;
+
+        // DIFFEVO_STOP_EVALS: Stop after this many cost function evaluations (over all problems of
+        // a batch).
+        unsigned long long max_evals;
+    } stop_params;
+
+    // Allows you to survive the death of the process during long runs. Requires the OpenCL backend
+    // and is not supported with islands.
+    struct {
+        // Path of the checkpoint file, a compact binary snapshot of the population, the costs, the
+        // RNG states and the generation. It is replaced atomically every interval generations.
+        // NULL, if not needed.
+        const char *path;
+
+        // Number of generations between two checkpoints. The snapshot is read back without
+        // blocking and written while the device already runs the next generations.
+        // e.g. 10000
+        unsigned interval;
+
+        // If non-zero and the file at path exists, the run continues from the checkpoint instead
+        // of initializing a new population, i.e. with the remaining of the num_iter generations.
+        // The checkpoint must stem from the same num_pop, num_attr, number of problems, layout,
+        // precision and rng. Apart from the stopping criteria, which start anew, the result is the
+        // same as if the run had never been interrupted.
+        // 0, if not needed.
+        unsigned resume;
+    } checkpoint_params;
+
+    // Allows you to monitor long runs while they are going on. Requires the OpenCL backend and is
+    // not supported with islands.
+    struct {
+        // Number of generations between two progress reports, each of which reads back the costs
+        // of the population (without blocking the device).
+        // e.g. 100; 0, if not needed.
+        unsigned interval;
+
+        // Called with every report, from the thread that runs the algorithm.
+        // NULL, if not needed.
+        diffevo_progress_fn callback;
+
+        // Passed to callback as is.
+        void *user_data;
+
+        // Path of a text file every report is appended to, one line "gen best mean" each.
+        // NULL, if not needed.
+        const char *log_path;
+    } progress_params;
+
+    // Allows you to restrict the search space, so that infeasible candidates never enter the
+    // population.
+    struct {
+        // Lower and upper bound of every attribute (num_attr each, both finite). The initial
+        // population is then drawn uniformly within the bounds instead of from Normal(mu,
+        // sigma^2), and mutated attributes that leave them are repaired, see repair.
+        // NULL, if not needed.
+        const double *lower;
+        const double *upper;
+
+        // How attributes outside their bounds are repaired. DIFFEVO_REPAIR_CLAMP moves them onto
+        // the bound, DIFFEVO_REPAIR_REFLECT mirrors them at the bound, DIFFEVO_REPAIR_RESAMPLE
+        // draws them anew within the bounds.
+        // DIFFEVO_REPAIR_CLAMP (0) by default.
+        unsigned repair;
+
+        // If non-zero, your source provides a device function
+        //     bool feasible(const real_t *x, unsigned num_attr, DIFFEVO_CONST void *eval_data);
+        // that is consulted for every (repaired) trial. Infeasible trials always lose against
+        // their parent, infeasible members of the initial population get an infinite cost. Only
+        // fused mode saves their evaluation (counted in num_evals_saved): an eval() kernel runs
+        // for the whole trial population, i.e. it still evaluates a copy of the parent in place
+        // of every infeasible trial, whose cost is then discarded. Implies compiling num_attr into
+        // the program, and requires the OpenCL backend without cost_fn. Not used by the
+        // high-dimensional kernels (high_dim_attr).
+        // 0, if not needed.
+        unsigned feasible;
+    } constraint_params;
+
+    // Allows you to split the population into islands, one per OpenCL device, that evolve
+    // independently and exchange their best members every few generations.
+    struct {
+        // Number of islands, each with num_pop members and its own context, queue and buffers.
+        // The islands are distributed round-robin over the devices of all platforms. Requires the
+        // OpenCL backend and the array of structures layout, and supports neither cost_fn nor
+        // batches. The stopping criteria are checked every check_interval generations as well as
+        // at every migration.
+        // e.g. 4; 0, if not needed.
+        unsigned num_islands;
+
+        // If non-zero, devices that support it are partitioned into sub-devices of this many
+        // compute units each (e.g. to run several islands on a multi-core CPU).
+        // e.g. 4; 0, if not needed.
+        unsigned sub_device_units;
+
+        // Number of generations between two migrations.
+        // e.g. 50
+        unsigned interval;
+
+        // Number of best members every island sends to its neighbor(s), where they replace the
+        // worst members. Must leave room for them, i.e. at most num_pop / 3.
+        // e.g. 2
+        unsigned num_migrants;
+
+        // DIFFEVO_RING sends the migrants to the next island only, DIFFEVO_RING_BIDIRECTIONAL to
+        // the previous one as well.
+        // DIFFEVO_RING (0) by default.
+        unsigned topology;
+    } island_params;
+
+    // Allows you to see where the time of a run goes, see profile in diffevo_stats_t.
+    struct {
+        // If non-zero, the queue is created with CL_QUEUE_PROFILING_ENABLE and the device times of
+        // every command as well as the host phases are measured. Only used by diffevo_create(),
+        // as profiling may slow down the queue. Not supported by the native backend.
+        // 0, if not needed.
+        unsigned enabled;
+
+        // If set (and profiling is enabled), every run writes a trace of its commands and host
+        // phases to this file, which can be opened in chrome://tracing or Perfetto. Like the
+        // profile, the trace of the first run includes the phases of diffevo_create().
+        // e.g. "trace.json"; NULL, if not needed.
+        const char *trace_path;
+    } profile_params;
+
+    // Type of the OpenCL device to run on, the first device of this type of all platforms is
+    // selected. Only used by diffevo_create() and diffevo_solve(), and not by islands.
+    // e.g. DIFFEVO_DEVICE_CPU for reproducible benchmarks; DIFFEVO_DEVICE_ANY (0) by default.
+    unsigned device_type;
+
+    // Directory in which compiled program binaries are cached between processes. The binaries are
+    // keyed by the sources, build options and device/driver, and silently rebuilt from source if
+    // the driver rejects them. Only used by diffevo_create() and diffevo_solve().
+    // NULL, if not needed.
+    const char *cache_dir;
 } diffevo_params_t;
 
 #ifdef _diffevo_export
@@ -62,11 +445,191 @@ typedef struct {
 #define _dll __declspec(dllimport)
 #endif
 
+// Accumulated device times (in seconds) of all commands of a type, see DIFFEVO_KERNEL_*.
+typedef struct {
+    // Number of commands.
+    unsigned count;
+
+    // Time between enqueueing and submission to the device, i.e. spent in the host queue.
+    double queued;
+
+    // Time between submission and start of execution, i.e. launch latency.
+    double submitted;
+
+    // Time between start and end of execution.
+    double executed;
+} diffevo_kernel_profile_t;
+
+// Profile of a run, see profile_params in diffevo_params_t. Many commands with a short executed
+// time compared to their queued and submitted times indicate that a run is launch-bound (see
+// fused and persistent).
+typedef struct {
+    diffevo_kernel_profile_t kernels[DIFFEVO_NUM_KERNELS];
+
+    // Wall-clock time in seconds spent by the host in each phase, see DIFFEVO_PHASE_*.
+    double phases[DIFFEVO_NUM_PHASES];
+} diffevo_profile_t;
+
+// Statistics of a run, see diffevo_stats().
+typedef struct {
+    // Number of generations actually executed, including the ones before a resumed checkpoint.
+    unsigned num_gen;
+
+    // Number of cost function evaluations of this run (over all problems of a batch), including
+    // the initial population unless it was resumed from a checkpoint. Initial members with known
+    // costs (see init_params) are not evaluated and therefore not counted.
+    unsigned long long num_evals;
+
+    // Number of the num_evals that were actually skipped, because the trial equaled its parent
+    // (see force_mutant). Always 0 with an eval() kernel.
+    unsigned long long num_evals_saved;
+
+    // The DIFFEVO_STOP_* criterion that stopped the algorithm, 0 if it ran for num_iter.
+    unsigned stop_reason;
+
+    // Profile of the run (summed over all islands), all zero unless profiling is enabled.
+    diffevo_profile_t profile;
+} diffevo_stats_t;
+
+// A single problem of a batch, see diffevo_run_batch(). All problems of a batch share the
+// parameters and the eval() kernel, but each has its own eval data, initial distribution and seed.
+typedef struct {
+    // Pointer to the eval data of this problem, eval_params.const_data_size bytes are copied from
+    // it. The eval() kernel finds it through DIFFEVO_PROBLEM_DATA(eval_data, id).
+    // NULL, if not needed.
+    const void *const_data_ptr;
+
+    // Initial candidates are Normal(mu, sigma^2) distributed, see mu in diffevo_params_t.
+    // e.g. 0
+    double mu;
+
+    // Initial candidates are Normal(mu, sigma^2) distributed, see sigma in diffevo_params_t.
+    // e.g. 1
+    double sigma;
+
+    // Seed of the random number generators of this problem. A fixed seed makes the result of the
+    // problem independent of the other problems in the batch.
+    // e.g. 42; 0 for a random seed.
+    unsigned seed;
+
+    // Known candidates (and optionally their costs) the initial population of this problem starts
+    // with, see init_params in diffevo_params_t.
+    // NULL and 0, if not needed.
+    const double *init_pop;
+    unsigned num_init;
+    const double *init_costs;
+} diffevo_problem_t;
+
+// Opaque solver handle. It keeps the OpenCL context, the compiled program and the buffers alive
+// between runs, so that solving the same problem repeatedly only pays for the actual iterations.
+typedef struct diffevo diffevo_t;
+
+// Asynchronous run on a handle, see diffevo_run_async().
+typedef struct diffevo_async diffevo_async_t;
+
+// Creates a solver handle: selects the device, creates the context and compiles the given eval()
+// kernel together with the DE algorithm. A handle must not be used by multiple threads at once,
+// but different handles (also on the same device) may be used concurrently.
+//
+// - path: Path of the file containing the eval() kernel source (i.e. your minimization problem).
+//   May be NULL for the native backend or if cost_fn is set.
+// - params: Optional pointer to parameters used to size the buffers up front, NULL otherwise.
+//   Selects the backend, the OpenCL backend is used without them.
+// - de: Pointer to where the handle will be written to.
+//
+// Returns 0, if the execution was successful, otherwise a non-zero value.
+_dll int diffevo_create(const char *path, const diffevo_params_t *params, diffevo_t **de);
+
+// Solves a minimization problem on an existing handle. The buffers are reused from previous runs
+// and only reallocated if num_pop or num_attr have grown.
+//
+// - de: Handle created by diffevo_create().
+// - params: Pointer to the parameters of the algorithm.
+// - best: Pointer to where the best candidate (i.e. all its attributes) will be written to.
+// - cost: Pointer to where the cost of the best candidate will be written to.
+//
+// Returns 0, if the execution was successful, otherwise a non-zero value.
+_dll int diffevo_run(diffevo_t *de, const diffevo_params_t *params, double *best, double *cost);
+
+// Solves many independent minimization problems at once on an existing handle. The populations of
+// all problems are stored in the same buffers, so that every kernel launch advances all of them,
+// which saturates the device even if a single problem is way too small to. The mu, sigma and
+// const_data_ptr members of params are ignored in favor of the ones of each problem. Stopping
+// criteria only stop once they are met by every problem. Neither the structure of arrays layout
+// nor zero_copy are supported for more than one problem.
+//
+// - de: Handle created by diffevo_create().
+// - params: Pointer to the parameters shared by all problems.
+// - problems: Pointer to num_problems problems.
+// - num_problems: Number of problems in the batch.
+// - best: Pointer to where the best candidates (num_attr attributes per problem, in the order of
+//   the problems) will be written to.
+// - cost: Pointer to where the costs of the best candidates (one per problem) will be written to.
+//
+// Returns 0, if the execution was successful, otherwise a non-zero value.
+_dll int diffevo_run_batch(diffevo_t *de, const diffevo_params_t *params,
+    const diffevo_problem_t *problems, unsigned num_problems, double *best, double *cost);
+
+// Starts diffevo_run_batch() on a worker thread and returns right away. The run keeps the handle
+// busy until it is waited for, any other run on it fails in the meantime. To solve several
+// problems concurrently, use one handle per problem (they share the device). params and problems
+// are copied, but the data they point to (e.g. const_data_ptr), best and cost must stay valid
+// until diffevo_wait() returns.
+//
+// - de: Handle created by diffevo_create().
+// - params, problems, num_problems, best, cost: See diffevo_run_batch().
+// - run: Pointer to where the handle of the run will be written to. It must be passed to
+//   diffevo_wait() exactly once, also after diffevo_cancel().
+//
+// Returns 0, if the run was started, otherwise a non-zero value.
+_dll int diffevo_run_async(diffevo_t *de, const diffevo_params_t *params,
+    const diffevo_problem_t *problems, unsigned num_problems, double *best, double *cost,
+    diffevo_async_t **run);
+
+// Checks whether an asynchronous run has finished, without blocking.
+//
+// Returns 1, if the run has finished, 0 if it is still running, otherwise a negative value.
+_dll int diffevo_poll(const diffevo_async_t *run);
+
+// Asks an asynchronous run to stop early. It stops at its next check, i.e. after the current chunk
+// of check_interval generations (50 without a check_interval, every generation on the native
+// backend), and still writes its best candidates so far, with DIFFEVO_STOP_CANCELLED as stop
+// reason. Returns immediately, use diffevo_wait() to wait for it.
+//
+// Returns 0, if the execution was successful, otherwise a non-zero value.
+_dll int diffevo_cancel(diffevo_async_t *run);
+
+// Waits for an asynchronous run to finish and releases its handle.
+//
+// Returns the result of the run, i.e. 0 if it was successful, otherwise a non-zero value.
+_dll int diffevo_wait(diffevo_async_t *run);
+
+// Retrieves the statistics of the most recent diffevo_run() on a handle.
+//
+// Returns 0, if the execution was successful, otherwise a non-zero value.
+_dll int diffevo_stats(const diffevo_t *de, diffevo_stats_t *stats);
+
+// Checks the Philox random number generator (see rng) against its known answers, i.e. the reference
+// vectors of Philox4x32-10 and a few draws of the members, on the host and, for the OpenCL backend,
+// on the device(s) of the handle. A mismatch means that runs with DIFFEVO_RNG_PHILOX are neither
+// reproducible across backends nor statistically sound.
+//
+// Returns 0, if all answers match, otherwise a non-zero value.
+_dll int diffevo_self_check(diffevo_t *de);
+
+// Releases a handle and all OpenCL resources associated with it. Passing NULL is a no-op.
+//
+// Returns 0, if the execution was successful, otherwise a non-zero value.
+_dll int diffevo_release(diffevo_t *de);
+
 // Solves a minimization problem using the Differential Evolution (DE) algorithm. Based on the given
 // parameters it will try to solve the problem in a highly parallelized OpenCL context.
-// This function is not safe for multi threading.
+// This is a shorthand for diffevo_create(), diffevo_run() and diffevo_release(). When solving
+// many problems with the same eval() kernel, prefer to keep a handle around instead.
+// Every call uses its own handle, so that multiple threads may call it at once.
 //
 // - path: Path of the file containing the eval() kernel source (i.e. your minimization problem).
+//   May be NULL for the native backend or if cost_fn is set.
 // - params: Pointer to the parameters of the algorithm.
 // - best: Pointer to where the best candidate (i.e. all its attributes) will be written to.
 // - cost: Pointer to where the cost of the best candidate will be written to.
@@ -0,0 +1,140 @@
+// Trick that allows us to directly include this file into diffevo.c as string.
+// Note, that the macro argument must not contain commas outside of parentheses (e.g. declare
+// variables one at a time) nor preprocessor directives.
+#ifndef _s
+#define _s(x)
+#endif
+_s(
+
+//
+// Variants of mutate() and select() for constrained problems (DIFFEVO_FEASIBLE). The user source
+// provides a device function with the signature
+//
+//     bool feasible(const real_t *x, unsigned num_attr, DIFFEVO_CONST void *eval_data);
+//
+// which mutate_feasible() consults for every trial. An infeasible trial is replaced by a copy of
+// its parent and flagged (like a trial that equals its parent), so that eval() never sees it and
+// select_feasible() keeps the parent.
+// Members that are infeasible from the start get an infinite cost (see check_feasible()), so that
+// any feasible trial replaces them. Like in fused mode, DIFFEVO_NUM_ATTR is always defined.
+//
+
+__kernel void mutate_feasible(
+    DIFFEVO_RNG_STATE *restrict rng,
+    DIFFEVO_CONST real_t *restrict in_pop,
+    __global real_t *restrict out_pop,
+    unsigned num_pop,
+    unsigned num_attr,
+    real_t shrink,
+    real_t crossover,
+    unsigned gen,
+    DIFFEVO_CONST real_t *restrict bounds,
+    __global uchar *restrict flags,
+    __global const real_t *restrict status,
+    __global const real_t *restrict ctrl,
+    __global real_t *restrict trial,
+    DIFFEVO_CONST char *restrict eval_data
+) {
+    const unsigned id = get_global_id(0);
+    const unsigned base = id - id % _num_pop;
+
+    rng_t r;
+    rng_load(&r, rng, id, gen);
+
+    unsigned d[5];
+    draw_donors(&r, num_pop, num_attr, id - base, d);
+
+    const unsigned u = base + d[0];
+    const unsigned v = base + d[1];
+    const unsigned w = base + d[2];
+    const unsigned v2 = base + d[3];
+    const unsigned w2 = base + d[4];
+    const unsigned j = _mutant_index(rng_forced(&r));
+
+    real_t f = _shrink;
+    real_t cr = _crossover;
+    adapt_ctrl(&r, ctrl, id, num_pop, num_attr, &f, &cr);
+
+    real_t x[_num_attr];
+    bool changed = false;
+
+    for(unsigned a = 0; a < _num_attr; a++) {
+        const real_t p = DIFFEVO_POP(in_pop, id, a);
+        const real_t q = _mutant(p, _best(status, id, a), DIFFEVO_POP(in_pop, u, a),
+            DIFFEVO_POP(in_pop, v, a), DIFFEVO_POP(in_pop, w, a), DIFFEVO_POP(in_pop, v2, a),
+            DIFFEVO_POP(in_pop, w2, a), f);
+        const real_t y = rng_real(&r) >= cr && a != j ? p : q;
+        x[a] = _repair(y, bounds, a, rng_resample(&r, a));
+        changed |= x[a] != p;
+    }
+
+    rng_store(rng, id, &r);
+
+    const bool ok = _feasible(x, DIFFEVO_PROBLEM_DATA(eval_data, id));
+
+    for(unsigned a = 0; a < _num_attr; a++) {
+        DIFFEVO_POP(out_pop, id, a) = ok ? x[a] : DIFFEVO_POP(in_pop, id, a);
+    }
+
+    flags[id] = ok && changed;
+
+    if (0 != _adapt_mode) {
+        trial[3 * id] = f;
+        trial[3 * id + 1] = cr;
+    }
+}
+
+__kernel void select_feasible(
+    DIFFEVO_CONST real_t *restrict in1_pop,
+    DIFFEVO_CONST real_t *restrict in1_cost,
+    DIFFEVO_CONST real_t *restrict in2_pop,
+    DIFFEVO_CONST real_t *restrict in2_cost,
+    __global real_t *restrict out_pop,
+    __global real_t *restrict out_cost,
+    unsigned num_pop,
+    unsigned num_attr,
+    __global real_t *restrict ctrl,
+    __global real_t *restrict trial,
+    DIFFEVO_CONST uchar *restrict flags
+) {
+    const unsigned id = get_global_id(0);
+
+    // Feasibility first: an infeasible trial always loses, an infeasible parent (infinite cost)
+    // loses against every feasible trial. A trial that equals its parent keeps the parent.
+    const bool better_1 = !flags[id] || in1_cost[id] < in2_cost[id];
+
+    for(unsigned a = 0; a < _num_attr; a++) {
+        DIFFEVO_POP(out_pop, id, a) = better_1 ? DIFFEVO_POP(in1_pop, id, a)
+            : DIFFEVO_POP(in2_pop, id, a);
+    }
+
+    out_cost[id] = better_1 ? in1_cost[id] : in2_cost[id];
+
+    if (0 != _adapt_mode) {
+        adapt_record(ctrl, trial, id, trial[3 * id], trial[3 * id + 1], !better_1,
+            in1_cost[id] - in2_cost[id]);
+    }
+}
+
+// Gives the infeasible members of the initial population an infinite cost, after eval().
+__kernel void check_feasible(
+    DIFFEVO_CONST real_t *restrict pop,
+    __global real_t *restrict costs,
+    unsigned num_pop,
+    unsigned num_attr,
+    DIFFEVO_CONST char *restrict eval_data
+) {
+    const unsigned id = get_global_id(0);
+
+    real_t x[_num_attr];
+
+    for(unsigned a = 0; a < _num_attr; a++) {
+        x[a] = DIFFEVO_POP(pop, id, a);
+    }
+
+    if (!_feasible(x, DIFFEVO_PROBLEM_DATA(eval_data, id))) {
+        costs[id] = INFINITY;
+    }
+}
+
+)
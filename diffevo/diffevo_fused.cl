@@ -0,0 +1,220 @@
+// Trick that allows us to directly include this file into diffevo.c as string.
+// Note, that the macro argument must not contain commas outside of parentheses (e.g. declare
+// variables one at a time) nor preprocessor directives.
+#ifndef _s
+#define _s(x)
+#endif
+_s(
+
+//
+// Fused Differential Evolution (DE) generation. Instead of an eval() kernel the user source
+// provides an inlinable cost function with the signature
+//
+//     real_t cost(const real_t *x, unsigned num_attr, DIFFEVO_CONST void *eval_data);
+//
+// which allows us to mutate, evaluate and select every member within a single kernel launch. The
+// trial vector never leaves private memory, which is why DIFFEVO_NUM_ATTR is always defined when
+// this source is part of the program. For a batch, cost() receives the eval data of the problem the
+// candidate belongs to.
+//
+// Infeasible candidates (see _feasible()) are never passed to cost(): they get an infinite cost,
+// and an infeasible trial always loses against its parent. Neither are trials that equal their
+// parent, which keep the parent instead and are counted in saved.
+//
+
+__kernel void fused_eval(
+    DIFFEVO_CONST real_t *restrict pop,
+    __global real_t *restrict costs,
+    unsigned num_pop,
+    unsigned num_attr,
+    DIFFEVO_CONST char *restrict eval_data
+) {
+    const unsigned id = get_global_id(0);
+
+    real_t x[_num_attr];
+
+    for(unsigned a = 0; a < _num_attr; a++) {
+        x[a] = DIFFEVO_POP(pop, id, a);
+    }
+
+    DIFFEVO_CONST void *data = DIFFEVO_PROBLEM_DATA(eval_data, id);
+    costs[id] = _feasible(x, data) ? cost(x, _num_attr, data) : INFINITY;
+}
+
+__kernel void generation(
+    DIFFEVO_RNG_STATE *restrict rng,
+    DIFFEVO_CONST real_t *restrict in_pop,
+    DIFFEVO_CONST real_t *restrict in_cost,
+    __global real_t *restrict out_pop,
+    __global real_t *restrict out_cost,
+    unsigned num_pop,
+    unsigned num_attr,
+    real_t shrink,
+    real_t crossover,
+    DIFFEVO_CONST char *restrict eval_data,
+    unsigned gen,
+    DIFFEVO_CONST real_t *restrict bounds,
+    __global unsigned *restrict saved,
+    __global const real_t *restrict status,
+    __global real_t *restrict ctrl,
+    __global real_t *restrict trial
+) {
+    const unsigned id = get_global_id(0);
+    const unsigned base = id - id % _num_pop;
+
+    rng_t r;
+    rng_load(&r, rng, id, gen);
+
+    unsigned d[5];
+    draw_donors(&r, num_pop, num_attr, id - base, d);
+
+    const unsigned u = base + d[0];
+    const unsigned v = base + d[1];
+    const unsigned w = base + d[2];
+    const unsigned v2 = base + d[3];
+    const unsigned w2 = base + d[4];
+    const unsigned j = _mutant_index(rng_forced(&r));
+
+    real_t f = _shrink;
+    real_t cr = _crossover;
+    adapt_ctrl(&r, ctrl, id, num_pop, num_attr, &f, &cr);
+
+    real_t x[_num_attr];
+    bool changed = false;
+
+    for(unsigned a = 0; a < _num_attr; a++) {
+        const real_t p = DIFFEVO_POP(in_pop, id, a);
+        const real_t q = _mutant(p, _best(status, id, a), DIFFEVO_POP(in_pop, u, a),
+            DIFFEVO_POP(in_pop, v, a), DIFFEVO_POP(in_pop, w, a), DIFFEVO_POP(in_pop, v2, a),
+            DIFFEVO_POP(in_pop, w2, a), f);
+        const real_t y = rng_real(&r) >= cr && a != j ? p : q;
+        x[a] = _repair(y, bounds, a, rng_resample(&r, a));
+        changed |= x[a] != p;
+    }
+
+    rng_store(rng, id, &r);
+
+    if (!changed) {
+        atomic_inc(saved);
+    }
+
+    // Same tie-breaking as select(): the trial only loses if the current member is strictly better.
+    DIFFEVO_CONST void *data = DIFFEVO_PROBLEM_DATA(eval_data, id);
+    const bool new_2 = changed && _feasible(x, data);
+    const real_t c = new_2 ? cost(x, _num_attr, data) : INFINITY;
+    const bool better_1 = !new_2 || in_cost[id] < c;
+
+    for(unsigned a = 0; a < _num_attr; a++) {
+        DIFFEVO_POP(out_pop, id, a) = better_1 ? DIFFEVO_POP(in_pop, id, a) : x[a];
+    }
+
+    out_cost[id] = better_1 ? in_cost[id] : c;
+
+    adapt_record(ctrl, trial, id, f, cr, !better_1, in_cost[id] - c);
+}
+
+//
+// Persistent variant for small populations: a single work group (one work item per member) runs
+// num_gen generations within one launch. The population lives in local memory in between (always
+// stored member by member), only the final population and costs are written back to global
+// memory (in place). A batch is run as one work group per problem. Supports the mutation
+// strategies, but not DIFFEVO_ADAPT (see check_params()).
+//
+
+__kernel void generations(
+    DIFFEVO_RNG_STATE *restrict rng,
+    __global real_t *restrict pop,
+    __global real_t *restrict costs,
+    unsigned num_pop,
+    unsigned num_attr,
+    real_t shrink,
+    real_t crossover,
+    DIFFEVO_CONST char *restrict eval_data,
+    unsigned num_gen,
+    unsigned gen,
+    DIFFEVO_CONST real_t *restrict bounds,
+    __global unsigned *restrict saved,
+    __local real_t *restrict l_pop,
+    __local real_t *restrict l_cost
+) {
+    const unsigned id = get_local_id(0);
+    const unsigned m = get_global_id(0);
+    const unsigned t = id * _num_attr;
+
+    DIFFEVO_CONST void *data = DIFFEVO_PROBLEM_DATA(eval_data, m);
+
+    rng_t r;
+    rng_load(&r, rng, m, gen);
+
+    for(unsigned a = 0; a < _num_attr; a++) {
+        l_pop[t + a] = DIFFEVO_POP(pop, m, a);
+    }
+    l_cost[id] = costs[m];
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    real_t x[_num_attr];
+    unsigned num_saved = 0;
+
+    for(unsigned g = 0; g < num_gen; g++) {
+        rng_next_gen(&r, gen + g);
+
+        unsigned d[5];
+        draw_donors(&r, num_pop, num_attr, id, d);
+
+        const unsigned u = d[0] * _num_attr;
+        const unsigned v = d[1] * _num_attr;
+        const unsigned w = d[2] * _num_attr;
+        const unsigned v2 = d[3] * _num_attr;
+        const unsigned w2 = d[4] * _num_attr;
+        const unsigned j = _mutant_index(rng_forced(&r));
+
+        // The best member of the previous generation, with the same tie-breaking as reduce().
+        unsigned best = 0;
+        for(unsigned n = 1; _uses_best && n < _num_pop; n++) {
+            best = l_cost[n] < l_cost[best] ? n : best;
+        }
+        best *= _num_attr;
+
+        bool changed = false;
+
+        for(unsigned a = 0; a < _num_attr; a++) {
+            const real_t p = l_pop[t + a];
+            const real_t q = _mutant(p, l_pop[best + a], l_pop[u + a], l_pop[v + a],
+                l_pop[w + a], l_pop[v2 + a], l_pop[w2 + a], _shrink);
+            const real_t y = rng_real(&r) >= _crossover && a != j ? p : q;
+            x[a] = _repair(y, bounds, a, rng_resample(&r, a));
+            changed |= x[a] != p;
+        }
+
+        num_saved += !changed;
+
+        const bool new_2 = changed && _feasible(x, data);
+        const real_t c = new_2 ? cost(x, _num_attr, data) : INFINITY;
+
+        // All members have to be done reading the donors before anyone replaces itself.
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if (new_2 && !(l_cost[id] < c)) {
+            for(unsigned a = 0; a < _num_attr; a++) {
+                l_pop[t + a] = x[a];
+            }
+            l_cost[id] = c;
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    for(unsigned a = 0; a < _num_attr; a++) {
+        DIFFEVO_POP(pop, m, a) = l_pop[t + a];
+    }
+    costs[m] = l_cost[id];
+
+    rng_store(rng, m, &r);
+
+    if (0 != num_saved) {
+        atomic_add(saved, num_saved);
+    }
+}
+
+)
@@ -0,0 +1,81 @@
+#pragma once
+
+// Declarations shared between the OpenCL backend (diffevo.c) and the native backend
+// (diffevo_native.c). Not part of the public interface.
+
+#include "diffevo.h"
+
+void report_error(char *msg);
+
+// Wall-clock time in seconds, only meaningful relative to another call.
+double wall_time(void);
+
+// A fresh non-zero seed, different for every call.
+unsigned random_seed(void);
+
+// Generates the seeds of the RNGs of all members of all problems.
+void member_seeds(const diffevo_params_t *params, const diffevo_problem_t *problems,
+    unsigned num_problems, unsigned *seeds);
+
+// Whether the mutation strategy uses the best member of the population, see strategy.
+int uses_best(const diffevo_params_t *params);
+
+// Number of entries of the SHADE memory of every problem, see adapt_params.
+unsigned memory_size(const diffevo_params_t *params);
+
+// Progress of a run towards its stopping criteria.
+typedef struct {
+    double start_time;
+
+    // Best cost so far and the generation it was found in, for DIFFEVO_STOP_STALL.
+    double stall_cost;
+    unsigned stall_gen;
+} stop_state_t;
+
+void stop_init(stop_state_t *st);
+
+// Checks the criteria that depend on the costs of the population after num_gen generations. For a
+// batch, min_cost and spread are the ones of the worst problem. Returns the criterion that was
+// met, 0 if none.
+unsigned stop_check_costs(const diffevo_params_t *params, stop_state_t *st, unsigned num_gen,
+    double min_cost, double spread);
+
+// Checks the criteria that only depend on the host, i.e. time and number of evaluations.
+unsigned stop_check_host(const diffevo_params_t *params, const stop_state_t *st,
+    unsigned long long num_evals);
+
+// Number of initial members of the given problems whose costs are given, see init_params.
+unsigned num_known_costs(const diffevo_problem_t *problems, unsigned num_problems);
+
+// Number of evaluations of a run of members from generation first_gen to num_gen, including the
+// initial population (but the skipped members whose costs are known) if it started from scratch.
+unsigned long long num_evals(size_t members, unsigned skipped, unsigned first_gen,
+    unsigned num_gen);
+
+// State of the native backend, i.e. the populations and RNGs in host memory.
+typedef struct native native_t;
+
+// The Philox4x32-10 bijection of the counter ctr (four values) under the key (two values), the
+// same as philox4x32() in diffevo.cl.
+void philox4x32(const unsigned *ctr, const unsigned *key, unsigned *out);
+
+// Block of four Philox draws of a member (keyed by its seed) in generation gen, the same as
+// philox_block() in diffevo.cl.
+void philox_block(unsigned key, unsigned gen, unsigned block, unsigned *out);
+
+// Solves a batch of problems on the host, see diffevo_run_batch(). The state is (re)allocated as
+// needed and kept in *nt between runs. The run stops with DIFFEVO_STOP_CANCELLED as soon as
+// *cancel is non-zero.
+int native_run(native_t **nt, const diffevo_params_t *params, const diffevo_problem_t *problems,
+    unsigned num_problems, double *best, double *cost, diffevo_stats_t *stats,
+    const volatile long *cancel);
+
+void native_release(native_t *nt);
+
+// Evaluates count members with cost_fn on all cores of the host, starting with member first (of
+// all problems). pop, flags and costs point to the attributes, flag and cost of member first.
+// Members whose flag is zero (trials equal to their parent, see mutate()) are skipped and get an
+// infinite cost. Returns the number of skipped members. flags may be NULL to evaluate all.
+unsigned native_eval(const diffevo_params_t *params, const diffevo_problem_t *problems,
+    const double *pop, const unsigned char *flags, double *costs, unsigned first,
+    unsigned count);
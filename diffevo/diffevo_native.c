@@ -0,0 +1,744 @@
+#define _USE_MATH_DEFINES
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "diffevo_internal.h"
+
+//
+// Native backend: the algorithm of diffevo.cl on the host, without OpenCL. Every generation is a
+// single parallel loop over all members (of all problems) that mutates, evaluates and selects a
+// member at once, like generation() in fused mode. The loops are parallelized with OpenMP, whose
+// threads are kept alive in between, and the attribute loops are written such that the compiler
+// can vectorize them.
+//
+
+//
+// RFC 8682: TinyMT32 Pseudorandom Number Generator (PRNG), see diffevo.cl.
+//
+
+typedef struct {
+    unsigned st[4];
+} mt32_t;
+
+void mt32_next(mt32_t *r) {
+    unsigned y = r->st[3];
+    unsigned x = (r->st[0] & 0x7fffffffu) ^ r->st[1] ^ r->st[2];
+    x ^= (x << 1);
+    y ^= (y >> 1) ^ x;
+    r->st[0] = r->st[1];
+    r->st[1] = r->st[2];
+    r->st[2] = x ^ (y << 10);
+    r->st[3] = y;
+    if (y & 1) {
+        r->st[1] ^= 0x8f7011eeu;
+        r->st[2] ^= 0xfc78ff1fu;
+    }
+}
+
+void mt32_init(mt32_t *r, unsigned seed) {
+    r->st[0] = seed;
+    r->st[1] = 0x8f7011eeu;
+    r->st[2] = 0xfc78ff1fu;
+    r->st[3] = 0x3793fdffu;
+    for (int i = 1; i < 8; i++) {
+        r->st[i & 3] ^= i + 1812433253u * (r->st[(i - 1) & 3] ^ (r->st[(i - 1) & 3] >> 30));
+    }
+    for (int i = 0; i < 8; i++) {
+        mt32_next(r);
+    }
+}
+
+unsigned mt32_unsigned(mt32_t *r) {
+    mt32_next(r);
+    unsigned t0 = r->st[3];
+    unsigned t1 = r->st[0] + (r->st[2] >> 8);
+    t0 ^= t1;
+    if (t1 & 1) {
+        t0 ^= 0x3793fdffu;
+    }
+    return t0;
+}
+
+double mt32_double(mt32_t *r) {
+    return mt32_unsigned(r) * (1.0 / 4294967296.0);
+}
+
+//
+// Integer hash (lowbias32 by Chris Wellons), see diffevo.cl. As in mutate_2d(), the crossover
+// decisions are derived from a single draw, which keeps the attribute loop free of the sequential
+// RNG and thus vectorizable.
+//
+
+unsigned hash32(unsigned x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+double hash32_double(unsigned salt, unsigned i) {
+    return hash32(salt ^ hash32(i)) * (1.0 / 4294967296.0);
+}
+
+//
+// Philox4x32-10 counter-based RNG, see diffevo.cl. The draws are the same as in the kernels, which
+// makes runs with DIFFEVO_RNG_PHILOX reproducible across backends.
+//
+
+unsigned mul_hi32(unsigned a, unsigned b) {
+    return (unsigned) (((unsigned long long) a * b) >> 32);
+}
+
+void philox4x32(const unsigned *ctr, const unsigned *key, unsigned *out) {
+    unsigned c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+    unsigned k0 = key[0], k1 = key[1];
+
+    for (int i = 0; i < 10; i++) {
+        const unsigned hi0 = mul_hi32(0xd2511f53u, c0);
+        const unsigned lo0 = 0xd2511f53u * c0;
+        const unsigned hi1 = mul_hi32(0xcd9e8d57u, c2);
+        const unsigned lo1 = 0xcd9e8d57u * c2;
+        c0 = hi1 ^ c1 ^ k0;
+        c1 = lo1;
+        c2 = hi0 ^ c3 ^ k1;
+        c3 = lo0;
+        k0 += 0x9e3779b9u;
+        k1 += 0xbb67ae85u;
+    }
+
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+void philox_block(unsigned key, unsigned gen, unsigned block, unsigned *out) {
+    const unsigned ctr[4] = { block, gen, 0, 0 };
+    const unsigned k[2] = { key, 0x5bd1e995u };
+    philox4x32(ctr, k, out);
+}
+
+typedef struct {
+    unsigned key, gen, n;
+    unsigned buf[4];
+} philox_t;
+
+void philox_load(philox_t *r, unsigned key, unsigned gen) {
+    r->key = key;
+    r->gen = gen;
+    r->n = 0;
+}
+
+unsigned philox_unsigned(philox_t *r) {
+    if (0 == (r->n & 3)) {
+        philox_block(r->key, r->gen, r->n >> 2, r->buf);
+    }
+    return r->buf[r->n++ & 3];
+}
+
+double philox_double(philox_t *r) {
+    return philox_unsigned(r) * (1.0 / 4294967296.0);
+}
+
+unsigned philox_unsigned_at(unsigned key, unsigned gen, unsigned i) {
+    unsigned buf[4];
+    philox_block(key, gen, i >> 2, buf);
+    return buf[i & 3];
+}
+
+double philox_double_at(unsigned key, unsigned gen, unsigned i) {
+    return philox_unsigned_at(key, gen, i) * (1.0 / 4294967296.0);
+}
+
+// Moves attribute value x back into [lo, hi], see repair() in diffevo.cl.
+double repair(double x, double lo, double hi, unsigned mode, double u) {
+    if (DIFFEVO_REPAIR_RESAMPLE == mode) {
+        return lo + u * (hi - lo);
+    }
+    if (DIFFEVO_REPAIR_REFLECT == mode) {
+        x = x < lo ? 2.0 * lo - x : 2.0 * hi - x;
+    }
+    return fmin(fmax(x, lo), hi);
+}
+
+// Index of a donor within the population drawn from d, see pick_donor() in diffevo.cl.
+unsigned pick_donor(unsigned d, unsigned num_pop, unsigned t, unsigned e0, unsigned e1,
+    unsigned e2, unsigned e3) {
+    unsigned n = d % num_pop;
+
+    for (unsigned i = 0; n == t || n == e0 || n == e1 || n == e2 || n == e3; i++) {
+        d = hash32(d);
+        n = i < 16 ? d % num_pop : (n + 1) % num_pop;
+    }
+
+    return n;
+}
+
+// Next draw of a member in a generation, from Philox or the TinyMT32 state.
+unsigned next_draw(int philox, philox_t *pr, mt32_t *r) {
+    return philox ? philox_unsigned(pr) : mt32_unsigned(r);
+}
+
+// Draw i after the ones per attribute (see rng_extra), i.e. the next one with TinyMT32.
+unsigned extra_draw(int philox, philox_t *pr, mt32_t *r, unsigned num_attr, unsigned i) {
+    return philox ? philox_unsigned_at(pr->key, pr->gen, 3 + 2 * num_attr + i)
+        : mt32_unsigned(r);
+}
+
+// Mutant attribute of the strategy, see _mutant().
+double mutant(unsigned strategy, double p, double b, double u, double v, double w, double v2,
+    double w2, double f) {
+    switch (strategy) {
+    case DIFFEVO_STRATEGY_BEST_1:
+        return b + f * (u - v);
+    case DIFFEVO_STRATEGY_CURRENT_TO_BEST_1:
+        return p + f * (b - p) + f * (u - v);
+    case DIFFEVO_STRATEGY_RAND_2:
+        return u + f * (v - w) + f * (v2 - w2);
+    default:
+        return u + f * (v - w);
+    }
+}
+
+struct native {
+    // Capacity the buffers are currently allocated for. They are only reallocated once a run
+    // needs more than this.
+    unsigned cap_members, cap_attr, cap_threads;
+
+    // One RNG (and the seed it was initialized with, which keys Philox) per member and two
+    // populations (current and next generation).
+    mt32_t *rng;
+    unsigned *seeds;
+    double *pop[2], *costs[2];
+
+    // One trial vector per thread.
+    double *trial;
+
+    // Control parameters of every member (jDE) or the memory of every problem (SHADE), the ones
+    // of every trial with its gain, the next entry of the memory and the best member of every
+    // problem, see adapt_params and strategy.
+    double *ctrl, *trial_ctrl;
+    unsigned *next, *best;
+};
+
+unsigned max_threads(void) {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+unsigned thread_num(void) {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+void native_free_buffers(native_t *nt) {
+    free(nt->rng);
+    free(nt->seeds);
+    free(nt->trial);
+    free(nt->ctrl);
+    free(nt->trial_ctrl);
+    free(nt->next);
+    free(nt->best);
+    nt->rng = NULL;
+    nt->seeds = NULL;
+    nt->trial = NULL;
+    nt->ctrl = NULL;
+    nt->trial_ctrl = NULL;
+    nt->next = NULL;
+    nt->best = NULL;
+
+    for (unsigned i = 0; i < 2; i++) {
+        free(nt->pop[i]);
+        free(nt->costs[i]);
+        nt->pop[i] = NULL;
+        nt->costs[i] = NULL;
+    }
+
+    nt->cap_members = 0;
+    nt->cap_attr = 0;
+    nt->cap_threads = 0;
+}
+
+int native_alloc(native_t *nt, unsigned members, unsigned num_attr, unsigned num_threads) {
+    if (members <= nt->cap_members && num_attr <= nt->cap_attr
+        && num_threads <= nt->cap_threads) {
+        return 0;
+    }
+
+    // Never shrink in either dimension, see alloc_buffers().
+    members = members > nt->cap_members ? members : nt->cap_members;
+    num_attr = num_attr > nt->cap_attr ? num_attr : nt->cap_attr;
+    num_threads = num_threads > nt->cap_threads ? num_threads : nt->cap_threads;
+
+    native_free_buffers(nt);
+
+    nt->rng = malloc(members * sizeof(mt32_t));
+    nt->seeds = malloc(members * sizeof(unsigned));
+    nt->trial = malloc((size_t) num_threads * num_attr * sizeof(double));
+    nt->ctrl = malloc((size_t) members * 2 * sizeof(double));
+    nt->trial_ctrl = malloc((size_t) members * 3 * sizeof(double));
+    nt->next = malloc(members * sizeof(unsigned));
+    nt->best = malloc(members * sizeof(unsigned));
+    int ok = NULL != nt->rng && NULL != nt->seeds && NULL != nt->trial && NULL != nt->ctrl
+        && NULL != nt->trial_ctrl && NULL != nt->next && NULL != nt->best;
+
+    for (unsigned i = 0; i < 2; i++) {
+        nt->pop[i] = malloc((size_t) members * num_attr * sizeof(double));
+        nt->costs[i] = malloc(members * sizeof(double));
+        ok = ok && NULL != nt->pop[i] && NULL != nt->costs[i];
+    }
+
+    if (!ok) {
+        native_free_buffers(nt);
+        report_error("Out of memory");
+        return -1;
+    }
+
+    nt->cap_members = members;
+    nt->cap_attr = num_attr;
+    nt->cap_threads = num_threads;
+
+    return 0;
+}
+
+// Initializes the RNGs and the population from the seeds, and evaluates it, see init() and eval().
+void native_init(native_t *nt, const diffevo_params_t *params,
+    const diffevo_problem_t *problems, unsigned members) {
+    const unsigned num_attr = params->num_attr;
+    const int philox = DIFFEVO_RNG_PHILOX == params->rng;
+    const double *lower = params->constraint_params.lower;
+    const double *upper = params->constraint_params.upper;
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < (int) members; i++) {
+        const unsigned m = (unsigned) i;
+        const diffevo_problem_t *problem = &problems[m / params->num_pop];
+        const unsigned n = m % params->num_pop;
+        double *x = nt->pop[0] + (size_t) m * num_attr;
+
+        mt32_t r;
+        philox_t pr;
+        if (philox) {
+            philox_load(&pr, nt->seeds[m], 0);
+        } else {
+            mt32_init(&r, nt->seeds[m]);
+        }
+
+        for (unsigned a = 0; a < num_attr; a++) {
+            // Box-Muller method to generate a Normal(mu, sigma^2) distributed number, or uniform
+            // within the bounds (with the same draws as init()).
+            const double u = philox ? philox_double(&pr) : mt32_double(&r);
+            const double v = philox ? philox_double(&pr) : mt32_double(&r);
+            x[a] = NULL != lower ? lower[a] + u * (upper[a] - lower[a])
+                : problem->mu + problem->sigma * sqrt(-2.0 * log(1.0 - u)) * cos(2.0 * M_PI * v);
+        }
+
+        if (!philox) {
+            nt->rng[m] = r;
+        }
+
+        // The given initial members replace the drawn ones, which keeps the draws the same.
+        if (n < problem->num_init) {
+            memcpy(x, problem->init_pop + (size_t) n * num_attr, num_attr * sizeof(double));
+
+            if (NULL != problem->init_costs) {
+                nt->costs[0][m] = problem->init_costs[n];
+                continue;
+            }
+        }
+
+        nt->costs[0][m] = params->cost_fn(x, num_attr, problem->const_data_ptr);
+    }
+}
+
+unsigned native_eval(const diffevo_params_t *params, const diffevo_problem_t *problems,
+    const double *pop, const unsigned char *flags, double *costs, unsigned first,
+    unsigned count) {
+    const unsigned num_attr = params->num_attr;
+    int num_saved = 0;
+
+#pragma omp parallel for schedule(dynamic, 16) reduction(+:num_saved)
+    for (int i = 0; i < (int) count; i++) {
+        const unsigned m = first + (unsigned) i;
+
+        if (NULL != flags && !flags[i]) {
+            costs[i] = INFINITY;
+            num_saved++;
+            continue;
+        }
+
+        costs[i] = params->cost_fn(pop + (size_t) i * num_attr, num_attr,
+            problems[m / params->num_pop].const_data_ptr);
+    }
+
+    return (unsigned) num_saved;
+}
+
+// Replaces the shrink factor f and crossover probability cr of the trial of member m by adapted
+// ones, d being the four draws for them, see adapt_ctrl() in diffevo.cl.
+void native_adapt_ctrl(const native_t *nt, const diffevo_params_t *params, unsigned m,
+    const unsigned *d, double *f, double *cr) {
+    const double x = d[2] * (1.0 / 4294967296.0);
+    const double y = d[3] * (1.0 / 4294967296.0);
+
+    if (DIFFEVO_ADAPT_JDE == params->adapt_params.mode) {
+        *f = d[0] * (1.0 / 4294967296.0) < 0.1 ? 0.1 + 0.9 * (d[1] * (1.0 / 4294967296.0))
+            : nt->ctrl[2 * (size_t) m];
+        *cr = x < 0.1 ? y : nt->ctrl[2 * (size_t) m + 1];
+        return;
+    }
+
+    const unsigned h = memory_size(params);
+    const size_t k = 2 * ((size_t) (m / params->num_pop) * h + d[0] % h);
+
+    double s = 0;
+    for (unsigned i = 0; s <= 0 && i < 64; i++) {
+        s = nt->ctrl[k] + 0.1 * tan(M_PI * (hash32_double(d[1], i) - 0.5));
+    }
+    *f = s > 0 ? fmin(s, 1.0) : nt->ctrl[k];
+
+    const double z = sqrt(-2.0 * log(1.0 - x)) * cos(2.0 * M_PI * y);
+    *cr = fmin(fmax(nt->ctrl[k + 1] + 0.1 * z, 0.0), 1.0);
+}
+
+// Records the outcome of the trial of member m, see adapt_record() in diffevo.cl.
+void native_adapt_record(native_t *nt, const diffevo_params_t *params, unsigned m, double f,
+    double cr, int won, double gain) {
+    if (DIFFEVO_ADAPT_JDE == params->adapt_params.mode && won) {
+        nt->ctrl[2 * (size_t) m] = f;
+        nt->ctrl[2 * (size_t) m + 1] = cr;
+    }
+
+    if (DIFFEVO_ADAPT_SHADE == params->adapt_params.mode) {
+        nt->trial_ctrl[3 * (size_t) m] = f;
+        nt->trial_ctrl[3 * (size_t) m + 1] = cr;
+        nt->trial_ctrl[3 * (size_t) m + 2] = won && isfinite(gain) ? gain : 0.0;
+    }
+}
+
+// Updates the SHADE memory of every problem after a generation, see adapt().
+void native_adapt(native_t *nt, const diffevo_params_t *params, unsigned num_problems) {
+    const unsigned h = memory_size(params);
+
+    for (unsigned p = 0; p < num_problems; p++) {
+        double s_w = 0.0, s_f = 0.0, s_f2 = 0.0, s_cr = 0.0;
+
+        for (size_t n = (size_t) p * params->num_pop; n < (size_t) (p + 1) * params->num_pop;
+            n++) {
+            const double *t = nt->trial_ctrl + 3 * n;
+            s_w += t[2];
+            s_f += t[2] * t[0];
+            s_f2 += t[2] * t[0] * t[0];
+            s_cr += t[2] * t[1];
+        }
+
+        if (s_w > 0.0) {
+            const size_t k = 2 * ((size_t) p * h + nt->next[p]);
+            nt->ctrl[k] = s_f2 / s_f;
+            nt->ctrl[k + 1] = s_cr / s_w;
+            nt->next[p] = (nt->next[p] + 1) % h;
+        }
+    }
+}
+
+// Runs generation gen from population in into population out, see generation(). Returns the
+// number of trials that equaled their parent and were therefore not evaluated.
+unsigned native_generation(native_t *nt, const diffevo_params_t *params,
+    const diffevo_problem_t *problems, unsigned members, unsigned gen, unsigned in,
+    unsigned out) {
+    const unsigned num_pop = params->num_pop;
+    const unsigned num_attr = params->num_attr;
+    const double shrink = params->shrink;
+    const double crossover = params->crossover;
+
+    const double *in_pop = nt->pop[in];
+    const double *in_cost = nt->costs[in];
+    double *out_pop = nt->pop[out];
+    double *out_cost = nt->costs[out];
+    const int philox = DIFFEVO_RNG_PHILOX == params->rng;
+    const double *lower = params->constraint_params.lower;
+    const double *upper = params->constraint_params.upper;
+    const unsigned strategy = params->strategy;
+    const unsigned adapt = params->adapt_params.mode;
+    const int best = uses_best(params);
+    int num_saved = 0;
+
+    // The cost function may take very different times per candidate, so the members are handed
+    // out in small chunks instead of one contiguous range per thread.
+#pragma omp parallel for schedule(dynamic, 16) reduction(+:num_saved)
+    for (int i = 0; i < (int) members; i++) {
+        const unsigned m = (unsigned) i;
+        const unsigned base = m - m % num_pop;
+
+        // With Philox, the same draws as in the kernels: the donors, then one draw per attribute,
+        // then the ones made through rng_extra. With TinyMT32, the same order as mutate_2d().
+        mt32_t r;
+        philox_t pr;
+        unsigned salt = 0;
+
+        if (philox) {
+            philox_load(&pr, nt->seeds[m], gen);
+        } else {
+            r = nt->rng[m];
+        }
+
+        // Donors within the population, distinct from each other and from the member itself.
+        const unsigned t = m - base;
+        unsigned d[5] = { 0, 0, 0, 0, 0 };
+        d[0] = pick_donor(next_draw(philox, &pr, &r), num_pop, t, UINT_MAX, UINT_MAX, UINT_MAX,
+            UINT_MAX);
+        d[1] = pick_donor(next_draw(philox, &pr, &r), num_pop, t, d[0], UINT_MAX, UINT_MAX,
+            UINT_MAX);
+        d[2] = pick_donor(next_draw(philox, &pr, &r), num_pop, t, d[0], d[1], UINT_MAX, UINT_MAX);
+
+        if (DIFFEVO_STRATEGY_RAND_2 == strategy) {
+            d[3] = pick_donor(extra_draw(philox, &pr, &r, num_attr, 1), num_pop, t, d[0], d[1],
+                d[2], UINT_MAX);
+            d[4] = pick_donor(extra_draw(philox, &pr, &r, num_attr, 2), num_pop, t, d[0], d[1],
+                d[2], d[3]);
+        }
+
+        if (!philox) {
+            salt = mt32_unsigned(&r);
+        }
+
+        // Attribute that is always taken from the mutant, see _mutant_index().
+        unsigned j = UINT_MAX;
+        if (params->force_mutant) {
+            j = extra_draw(philox, &pr, &r, num_attr, 0) % num_attr;
+        }
+
+        double f = shrink;
+        double cr = crossover;
+
+        if (DIFFEVO_ADAPT_NONE != adapt) {
+            unsigned c[4];
+            for (unsigned k = 0; k < 4; k++) {
+                c[k] = extra_draw(philox, &pr, &r, num_attr, 3 + k);
+            }
+            native_adapt_ctrl(nt, params, m, c, &f, &cr);
+        }
+
+        if (!philox) {
+            nt->rng[m] = r;
+        }
+
+        const double *__restrict p = in_pop + (size_t) m * num_attr;
+        const double *__restrict b = best ? in_pop + (size_t) nt->best[m / num_pop] * num_attr : p;
+        const double *__restrict u = in_pop + (size_t) (base + d[0]) * num_attr;
+        const double *__restrict v = in_pop + (size_t) (base + d[1]) * num_attr;
+        const double *__restrict w = in_pop + (size_t) (base + d[2]) * num_attr;
+        const double *__restrict v2 = in_pop + (size_t) (base + d[3]) * num_attr;
+        const double *__restrict w2 = in_pop + (size_t) (base + d[4]) * num_attr;
+        double *__restrict x = nt->trial + (size_t) thread_num() * num_attr;
+
+        if (philox) {
+            for (unsigned a = 0; a < num_attr; a++) {
+                const double q = mutant(strategy, p[a], b[a], u[a], v[a], w[a], v2[a], w2[a], f);
+                x[a] = philox_double(&pr) >= cr && a != j ? p[a] : q;
+            }
+        } else {
+            for (unsigned a = 0; a < num_attr; a++) {
+                const double q = mutant(strategy, p[a], b[a], u[a], v[a], w[a], v2[a], w2[a], f);
+                x[a] = hash32_double(salt, a) >= cr && a != j ? p[a] : q;
+            }
+        }
+
+        // Kept out of the loops above, so that they still vectorize. The re-sampling draw is only
+        // computed for attributes that actually left their bounds, like _repair().
+        if (NULL != lower) {
+            for (unsigned a = 0; a < num_attr; a++) {
+                if (x[a] < lower[a] || x[a] > upper[a]) {
+                    const double s = philox
+                        ? philox_double_at(nt->seeds[m], gen, 3 + num_attr + a)
+                        : hash32_double(~salt, a);
+                    x[a] = repair(x[a], lower[a], upper[a], params->constraint_params.repair, s);
+                }
+            }
+        }
+
+        // A trial that equals its parent keeps the parent without being evaluated. Compared like
+        // in mutate(), so that all backends skip the same trials.
+        int changed = 0;
+        for (unsigned a = 0; a < num_attr; a++) {
+            changed |= x[a] != p[a];
+        }
+
+        if (!changed) {
+            memcpy(out_pop + (size_t) m * num_attr, p, num_attr * sizeof(double));
+            out_cost[m] = in_cost[m];
+            native_adapt_record(nt, params, m, f, cr, 0, 0.0);
+            num_saved++;
+            continue;
+        }
+
+        // Same tie-breaking as select(): the trial only loses if the current member is strictly
+        // better.
+        const double c = params->cost_fn(x, num_attr, problems[m / num_pop].const_data_ptr);
+        const int better_1 = in_cost[m] < c;
+
+        memcpy(out_pop + (size_t) m * num_attr, better_1 ? p : x, num_attr * sizeof(double));
+        out_cost[m] = better_1 ? in_cost[m] : c;
+        native_adapt_record(nt, params, m, f, cr, !better_1, in_cost[m] - c);
+    }
+
+    return (unsigned) num_saved;
+}
+
+// Determines the best member of problem p in population i, see reduce().
+unsigned native_best(const native_t *nt, const diffevo_params_t *params, unsigned p, unsigned i,
+    double *spread) {
+    const double *costs = nt->costs[i] + (size_t) p * params->num_pop;
+
+    double c_max = -INFINITY;
+    unsigned best = 0;
+
+    for (unsigned n = 0; n < params->num_pop; n++) {
+        if (costs[n] < costs[best]) {
+            best = n;
+        }
+        c_max = fmax(c_max, costs[n]);
+    }
+
+    *spread = c_max - costs[best];
+
+    return p * params->num_pop + best;
+}
+
+int native_run(native_t **nt, const diffevo_params_t *params, const diffevo_problem_t *problems,
+    unsigned num_problems, double *best, double *cost, diffevo_stats_t *stats,
+    const volatile long *cancel) {
+    const unsigned long long total = (unsigned long long) num_problems * params->num_pop;
+    if (total > INT_MAX) {
+        report_error("Too many members over all problems");
+        return -1;
+    }
+
+    const unsigned members = (unsigned) total;
+
+    if (NULL == *nt) {
+        *nt = calloc(1, sizeof(native_t));
+        if (NULL == *nt) {
+            report_error("Out of memory");
+            return -1;
+        }
+    }
+
+    if (0 != native_alloc(*nt, members, params->num_attr, max_threads())) {
+        return -1;
+    }
+
+    member_seeds(params, problems, num_problems, (*nt)->seeds);
+
+    native_init(*nt, params, problems, members);
+
+    // native_init() does not evaluate the initial members with known costs.
+    const unsigned skipped = num_known_costs(problems, num_problems);
+
+    if (DIFFEVO_ADAPT_NONE != params->adapt_params.mode) {
+        // Every member (jDE) or memory entry (SHADE) starts with shrink and crossover.
+        const size_t count = DIFFEVO_ADAPT_JDE == params->adapt_params.mode ? members
+            : (size_t) num_problems * memory_size(params);
+
+        for (size_t i = 0; i < count; i++) {
+            (*nt)->ctrl[2 * i] = params->shrink;
+            (*nt)->ctrl[2 * i + 1] = params->crossover;
+        }
+
+        // SHADE updates the first entry of the memory next.
+        memset((*nt)->next, 0, num_problems * sizeof(unsigned));
+    }
+
+    //
+    // Run the generations, checking the stopping criteria every check_interval generations.
+    //
+
+    const unsigned criteria = params->stop_params.criteria;
+
+    stop_state_t stop;
+    stop_init(&stop);
+
+    unsigned num_gen = 0;
+    unsigned reason = 0;
+    unsigned long long num_saved = 0;
+
+    while (num_gen < params->num_iter && 0 == reason) {
+        if (uses_best(params)) {
+            for (unsigned p = 0; p < num_problems; p++) {
+                double s;
+                (*nt)->best[p] = native_best(*nt, params, p, num_gen % 2, &s);
+            }
+        }
+
+        num_saved += native_generation(*nt, params, problems, members, num_gen + 1, num_gen % 2,
+            1 - num_gen % 2);
+        num_gen++;
+
+        if (DIFFEVO_ADAPT_SHADE == params->adapt_params.mode) {
+            native_adapt(*nt, params, num_problems);
+        }
+
+        // Every generation synchronizes the threads anyway, so checking it is free.
+        if (0 != *cancel) {
+            reason = DIFFEVO_STOP_CANCELLED;
+            break;
+        }
+
+        if (0 == criteria || 0 != num_gen % params->stop_params.check_interval) {
+            continue;
+        }
+
+        double min_cost = -INFINITY;
+        double spread = -INFINITY;
+
+        for (unsigned p = 0; p < num_problems; p++) {
+            double s;
+            const unsigned b = native_best(*nt, params, p, num_gen % 2, &s);
+            min_cost = fmax(min_cost, (*nt)->costs[num_gen % 2][b]);
+            spread = fmax(spread, s);
+        }
+
+        reason = stop_check_costs(params, &stop, num_gen, min_cost, spread);
+        if (0 == reason) {
+            reason = stop_check_host(params, &stop, num_evals(members, skipped, 0, num_gen));
+        }
+    }
+
+    stats->num_gen = num_gen;
+    stats->num_evals = num_evals(members, skipped, 0, num_gen);
+    stats->num_evals_saved = num_saved;
+    stats->stop_reason = reason;
+
+    for (unsigned p = 0; p < num_problems; p++) {
+        double s;
+        const unsigned b = native_best(*nt, params, p, num_gen % 2, &s);
+        cost[p] = (*nt)->costs[num_gen % 2][b];
+        memcpy(best + (size_t) p * params->num_attr, (*nt)->pop[num_gen % 2]
+            + (size_t) b * params->num_attr, params->num_attr * sizeof(double));
+    }
+
+    return 0;
+}
+
+void native_release(native_t *nt) {
+    if (NULL == nt) {
+        return;
+    }
+
+    native_free_buffers(nt);
+    free(nt);
+}